@@ -208,6 +208,7 @@ int main(void)
     arduino_sdl::connect_button(BUTTON_PINS[1], 100, 200);
     arduino_sdl::connect_button(BUTTON_PINS[2], 150, 150);
     arduino_sdl::connect_lcd(0x27, A4, A5, 16, 2, 200, 200);
+    arduino_sdl::connect_sonar(SONAR_TRIG_PIN, SONAR_ECHO_PIN, 100, 300);
     arduino_sdl::loop();
     arduino_sdl::quit();
     return 0;
@@ -0,0 +1,20 @@
+#include "arduino_sdl.h"
+
+// Runs ping.cpp and pong.cpp together, linked through both Serial and I2C.
+// Build with 'make cosim', then run out/cosim from the out directory.
+int main()
+{
+    arduino_sdl::start("Co-simulation example", 800, 600);
+    int master = arduino_sdl::add_board("./ping.so");
+    arduino_sdl::connect_potentiometer(A0, 200, 200);
+    arduino_sdl::connect_led(13, 200, 300, 0x004000ff, 0x00ff00ff);
+    int slave = arduino_sdl::add_board("./pong.so");
+    arduino_sdl::connect_led(9, 400, 200, 0x400000ff, 0xff0000ff);
+    if (master < 0 || slave < 0)
+        return 1;
+    arduino_sdl::link_serial(master, slave);
+    arduino_sdl::link_i2c(master, slave);
+    arduino_sdl::run_boards();
+    arduino_sdl::quit();
+    return 0;
+}
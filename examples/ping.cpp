@@ -0,0 +1,32 @@
+// Master for the co-simulation example (see cosim.cpp): sends a ping over
+// Serial every second and blinks its LED on every answer, and tells the
+// slave over I2C how bright its own LED should be.
+#include "arduino_sdl.h"
+#include <Wire.h>
+
+const uint8_t SLAVE_ADDR = 8;
+const int POT_PIN = A0;
+const int LED_PIN = 13;
+
+unsigned long last_ping = 0;
+int pongs = 0;
+
+void setup()
+{
+    Serial.begin(9600);
+    Wire.begin();
+}
+
+void loop()
+{
+    if (millis() - last_ping >= 1000) {
+        last_ping = millis();
+        Serial.println("ping");
+        Wire.beginTransmission(SLAVE_ADDR);
+        Wire.write(analogRead(POT_PIN) / 4);
+        Wire.endTransmission();
+    }
+    while (Serial.available())
+        if (Serial.read() == '\n')
+            digitalWrite(LED_PIN, ++pongs % 2);
+}
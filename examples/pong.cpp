@@ -0,0 +1,28 @@
+// Slave for the co-simulation example (see cosim.cpp): answers every line
+// received on Serial, and sets its LED to whatever the master sends on I2C.
+#include "arduino_sdl.h"
+#include <Wire.h>
+
+const uint8_t ADDR = 8;
+const int LED_PIN = 9;
+
+void receive(int n)
+{
+    while (Wire.available())
+        analogWrite(LED_PIN, Wire.read());
+}
+
+void setup()
+{
+    Serial.begin(9600);
+    Wire.begin(ADDR);
+    Wire.onReceive(receive);
+}
+
+void loop()
+{
+    while (Serial.available())
+        if (Serial.read() == '\n')
+            Serial.println("pong");
+    delay(10);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * EEPROM emulation. The contents are kept in a memory-mapped file (eeprom.bin
+ * by default, see arduino_sdl::eeprom_file()), so they persist between runs.
+ * The file also keeps how many times each cell was written, which is used to
+ * warn about sketches that would wear out a real EEPROM.
+ */
+
+struct EERef {
+    int index;
+
+    uint8_t operator*() const;
+    operator uint8_t() const { return **this; }
+    EERef & operator=(const EERef &ref) { return *this = *ref; }
+    EERef & operator=(uint8_t value);
+    EERef & update(uint8_t value);
+    EERef & operator+=(uint8_t n) { return *this = **this + n; }
+    EERef & operator-=(uint8_t n) { return *this = **this - n; }
+    EERef & operator++() { return *this += 1; }
+    EERef & operator--() { return *this -= 1; }
+};
+
+struct EEPROMClass {
+    EERef operator[](int index) { return { index }; }
+    uint8_t read(int index)                { return *EERef{index}; }
+    void write(int index, uint8_t value)   { EERef{index} = value; }
+    void update(int index, uint8_t value)  { EERef{index}.update(value); }
+    uint16_t length();
+
+    template <typename T>
+    T & get(int index, T &t)
+    {
+        auto *p = (uint8_t *) &t;
+        for (size_t i = 0; i < sizeof(T); i++)
+            p[i] = read(index + i);
+        return t;
+    }
+
+    template <typename T>
+    const T & put(int index, const T &t)
+    {
+        auto *p = (const uint8_t *) &t;
+        for (size_t i = 0; i < sizeof(T); i++)
+            update(index + i, p[i]);
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include "arduino_sdl.h"
 #include <Print.h>
 
 class LiquidCrystal_I2C : public Print {
@@ -15,5 +16,7 @@ public:
     void noBacklight();
     void clear();
     void setCursor(uint8_t x, uint8_t y);
+    void createChar(uint8_t location, const uint8_t charmap[]);
+    using Print::write;
     size_t write(uint8_t);
 };
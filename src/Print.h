@@ -1,12 +1,45 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
-#include "arduino_sdl.h"
+#include "arduino_string.h"
 
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+/*
+ * Shared by Serial and the LCD. Numbers are formatted into a buffer on the
+ * stack, so printing them never allocates anything.
+ */
 struct Print {
     virtual size_t write(uint8_t) = 0;
-    size_t write(const uint8_t *buffer, size_t size);
-    size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
-    size_t print(String s)      { return write((const uint8_t *)s.c_str(), s.length()); }
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+    size_t print(const char *s)     { return write(s); }
+    // an empty (or moved from) String has no buffer at all, and length()
+    // counts the terminating '\0', so only the text up to it is written
+    size_t print(const String &s)   { return s.c_str() ? write(s.c_str()) : 0; }
+    // flash is readable like RAM here, so no copy needed
+    size_t print(const __FlashStringHelper *s) { return write(reinterpret_cast<const char *>(s)); }
+    size_t print(char c)            { return write(uint8_t(c)); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned int) n, base); }
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(long long n, int base = DEC);
+    size_t print(unsigned long long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+
+    size_t println(const auto &...args)
+    {
+        size_t n = print(args...);
+        return n + println();
+    }
 };
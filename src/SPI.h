@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "arduino_sdl.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+#define SPI_CLOCK_DIV2   0x04
+#define SPI_CLOCK_DIV4   0x00
+#define SPI_CLOCK_DIV8   0x05
+#define SPI_CLOCK_DIV16  0x01
+#define SPI_CLOCK_DIV32  0x06
+#define SPI_CLOCK_DIV64  0x02
+#define SPI_CLOCK_DIV128 0x03
+
+struct SPISettings {
+    uint32_t clock;
+    uint8_t bit_order;
+    uint8_t data_mode;
+
+    SPISettings(uint32_t clock = 4000000, uint8_t bit_order = MSBFIRST, uint8_t data_mode = SPI_MODE0)
+        : clock{clock}, bit_order{bit_order}, data_mode{data_mode}
+    { }
+};
+
+struct SPIClass {
+    SPISettings settings;
+
+    void begin()                                { }
+    void end()                                  { }
+    void beginTransaction(SPISettings s)        { settings = s; }
+    void endTransaction()                       { }
+    void setBitOrder(uint8_t order)             { settings.bit_order = order; }
+    void setDataMode(uint8_t mode)              { settings.data_mode = mode; }
+    void setClockDivider(uint8_t div)           { }
+
+    uint8_t transfer(uint8_t data);
+    uint16_t transfer16(uint16_t data);
+    void transfer(void *buf, size_t count);
+};
+
+extern SPIClass SPI;
+
+/*
+ * A device on the SPI bus, connected with arduino_sdl::connect_spi_device().
+ * It is selected while its chip select pin is LOW. Everything sent to it is
+ * passed to transfer() in one go, and whatever the device answers must be
+ * written back into the same buffer, as on the real bus. Devices selected
+ * together each get what was sent, and the sketch gets the AND of their
+ * answers. With none selected, it reads 0xFF. The chip select pin has a
+ * pull-up, so the device isn't selected until the sketch drives it LOW.
+ */
+struct SPIDevice {
+    virtual ~SPIDevice() = default;
+    virtual void select(bool selected) { }
+    virtual void transfer(std::span<uint8_t> data) = 0;
+};
@@ -6,9 +6,13 @@ struct _wire {
     uint8_t cur_addr;
 
     void begin()                         { cur_addr = 0; }
+    void begin(uint8_t addr);            // join the bus as a slave
     void beginTransmission(uint8_t addr) { cur_addr = addr; }
-    void endTransmission()               { cur_addr = 0; }
+    uint8_t endTransmission();
     void write(uint8_t data);
+    int available();
+    int read();
+    void onReceive(void (*handler)(int));
 };
 
 extern _wire Wire;
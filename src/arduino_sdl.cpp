@@ -1,38 +1,31 @@
+/*
+ * The SDL frontend: draws the boards in a window, and takes mouse and
+ * keyboard input. Sound from tone() is played through SDL too.
+ */
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cstdint>
 #include <ctime>
-#include <charconv>
-#include <memory>
-#include <functional>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
-#include <utility>
 #include <SDL2/SDL.h>
 #include <glm/glm.hpp>
-#include <fmt/core.h>
-#include "arduino_sdl.h"
-#include "arduino_string.h"
-#include "Wire.h"
-#include "Print.h"
-#include "LiquidCrystal_I2C.h"
+#include "core.h"
+#include "audio.h"
+#include "blit.h"
+#include "frame_capture.h"
 
 
 
 /* constants, typedefs, etc. */
 
-#define FWD(...) std::forward<decltype(__VA_ARGS__)>(__VA_ARGS__)
-
-using u32 = uint32_t;
 using glm::vec2;
 
-struct Rect {
-    vec2 pos;
-    vec2 size;
-};
-
 // NOTE: remember to sync these with the load_gfx function
 enum {
     TEXTURE_BUTTON,
@@ -45,24 +38,22 @@ enum {
 
 /* utility functions for rendering */
 
-bool collision_rect_point(Rect r, vec2 p)
-{
-    return p.x >= r.pos.x && p.x <= r.pos.x + r.size.x
-        && p.y >= r.pos.y && p.y <= r.pos.y + r.size.y;
-}
-
+// Calls draw(x1, x2, y) for each horizontal span of the circle, both ends
+// included, so that it can be drawn with one call per row.
 void circle_rasterizer(float cx, float cy, float r, auto &&draw)
 {
     float x1 = cx - r, y1 = cy - r,
           x2 = cx + r, y2 = cy + r;
     for (auto y = y1; y < y2; y++) {
-        for (auto x = x1; x < x2; x++) {
-            auto xdist = x - cx + 0.5f,
-                 ydist = y - cy + 0.5f;
-            auto dist2 = xdist*xdist + ydist*ydist;
-            if (dist2 <= r*r)
-                draw(x, y);
-        }
+        auto ydist = y - cy + 0.5f;
+        if (ydist*ydist > r*r)
+            continue;
+        // a pixel at x is inside if |x - cx + 0.5| <= half
+        auto half = std::sqrt(r*r - ydist*ydist);
+        auto first = std::max(0.f,                     std::ceil (cx - 0.5f - half - x1));
+        auto last  = std::min(std::ceil(x2 - x1) - 1, std::floor(cx - 0.5f + half - x1));
+        if (first <= last)
+            draw(int(x1 + first), int(x1 + last), int(y));
     }
 }
 
@@ -85,66 +76,73 @@ u32 lerp_rgba(u32 min, u32 max, float t)
 
 
 
-/*
- * component and board declarations.
- * all these classes are intentionally written to have as few methods
- * as possible.
- */
-
-struct Component {
-    virtual int  digital_read(uint8_t pin) = 0;
-    virtual void digital_write(uint8_t pin, uint8_t value) = 0;
-    virtual int  analog_read(uint8_t pin) = 0;
-    virtual void analog_write(uint8_t pin, uint8_t value) = 0;
-    virtual void mouse_click(vec2 mouse_pos, bool pressed) = 0;
-    virtual void mouse_wheel(vec2 mouse_pos, bool up_or_down) = 0;
-    virtual void draw() = 0;
-};
-
-struct ArduinoBoard {
-    std::vector<std::unique_ptr<Component>> components;
-    std::array<int, 20> ports;
-    std::unordered_map<uint8_t, std::function<void(uint8_t)>> i2c_bus;
-
-    template <typename T>
-    int push_component(auto&&... args)
-    {
-        components.emplace_back(std::make_unique<T>(FWD(args)...));
-        return components.size() - 1;
-    }
-
-    void add_i2c(uint8_t addr, auto &&fn)
-    {
-        i2c_bus[addr] = fn;
-    }
-} board;
-
 struct {
-    bool running = true;
     SDL_Window *window;
     SDL_Renderer *rd;
-    vec2 mouse_pos;
+    Point mouse_pos;
+    int width, height;
+
+    // The software renderer draws everything into a framebuffer in memory,
+    // then copies it to the window with a single blit per frame.
+    bool software = false;
+    std::vector<u32> framebuffer;
+    SDL_Surface *fb_surface;
 
     void init(const char *title, int width, int height)
     {
+        this->width  = width;
+        this->height = height;
+        if (auto *r = getenv("ARDUINO_SDL_RENDERER"); r && strcmp(r, "software") == 0)
+            software = true;
         SDL_Init(SDL_INIT_VIDEO);
         window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                                   width, height, SDL_WINDOW_SHOWN);
-        rd = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        if (software) {
+            framebuffer = std::vector<u32>(width * height, 0xff000000);
+            fb_surface = SDL_CreateRGBSurfaceWithFormatFrom(framebuffer.data(), width, height, 32,
+                                                            width * 4, SDL_PIXELFORMAT_ARGB8888);
+            SDL_SetSurfaceBlendMode(fb_surface, SDL_BLENDMODE_NONE);
+        } else
+            rd = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     }
 
     void quit()
     {
-        SDL_DestroyRenderer(rd);
+        if (software)
+            SDL_FreeSurface(fb_surface);
+        else
+            SDL_DestroyRenderer(rd);
         SDL_DestroyWindow(window);
         SDL_Quit();
     }
+
+    void clear()
+    {
+        if (software)
+            fill_row(framebuffer.data(), framebuffer.size(), 0xff000000);
+        else {
+            SDL_SetRenderDrawColor(rd, 0, 0, 0, 0xff);
+            SDL_RenderClear(rd);
+        }
+    }
+
+    void present()
+    {
+        if (software) {
+            SDL_BlitSurface(fb_surface, nullptr, SDL_GetWindowSurface(window), nullptr);
+            SDL_UpdateWindowSurface(window);
+        } else
+            SDL_RenderPresent(rd);
+    }
 } SDL;
 
 struct Texture {
     SDL_Texture *data;
     vec2 size;
     vec2 image_size;
+    // used by the software renderer instead of data
+    SDL_Surface *pixels = nullptr;
+    bool opaque = true;
 };
 
 struct {
@@ -160,49 +158,76 @@ struct {
 
 
 
+
 /*
- * Some more utility functions. In particular, poll() is used to poll OS events,
- * load_gfx loads texture from BMP files, while the others are rendering 'primitives'.
+ * Some more utility functions. load_gfx loads texture from BMP files, while
+ * the others are rendering 'primitives'.
  */
 
 namespace {
 
-void poll()
-{
-    for (SDL_Event ev; SDL_PollEvent(&ev); ) {
-        switch (ev.type) {
-        case SDL_QUIT:
-            SDL.running = false;
-            exit(0);
-            break;
-        case SDL_KEYUP:
-        case SDL_KEYDOWN:
-            break;
-        case SDL_MOUSEBUTTONDOWN:
-        case SDL_MOUSEBUTTONUP:
-            if (ev.button.button == SDL_BUTTON_LEFT)
-                for (auto &c : board.components)
-                    c->mouse_click({ev.button.x, ev.button.y}, ev.button.state == SDL_PRESSED);
-            break;
-        case SDL_MOUSEWHEEL:
-            for (auto &c : board.components)
-                c->mouse_wheel(SDL.mouse_pos, ev.wheel.y > 0);
-            break;
-        case SDL_MOUSEMOTION:
-            SDL.mouse_pos.x = ev.motion.x;
-            SDL.mouse_pos.y = ev.motion.y;
-            break;
-        }
-    }
-}
-
 int load_gfx(std::string_view pathname, vec2 frame_size)
 {
     auto *bmp = SDL_LoadBMP(pathname.data());
     assert(bmp && "load of bmp image failed");
-    auto *tex = SDL_CreateTextureFromSurface(SDL.rd, bmp);
+    Texture tex = { .data = nullptr, .size = frame_size, .image_size = {bmp->w, bmp->h} };
+    if (SDL.software) {
+        tex.pixels = SDL_ConvertSurfaceFormat(bmp, SDL_PIXELFORMAT_ARGB8888, 0);
+        auto *p = (const u32 *) tex.pixels->pixels;
+        tex.opaque = std::all_of(p, p + tex.pixels->h * tex.pixels->pitch / 4,
+                                 [](u32 px) { return px >> 24 == 0xff; });
+    } else
+        tex.data = SDL_CreateTextureFromSurface(SDL.rd, bmp);
     SDL_FreeSurface(bmp);
-    return gfx_handler.add((Texture) { .data = tex, .size = frame_size, .image_size = {bmp->w, bmp->h} });
+    return gfx_handler.add(std::move(tex));
+}
+
+// Creates a blank texture, to be filled with update_gfx().
+int create_gfx(vec2 image_size, vec2 frame_size)
+{
+    Texture tex = { .data = nullptr, .size = frame_size, .image_size = image_size };
+    if (SDL.software)
+        tex.pixels = SDL_CreateRGBSurfaceWithFormat(0, image_size.x, image_size.y, 32, SDL_PIXELFORMAT_ARGB8888);
+    else
+        tex.data = SDL_CreateTexture(SDL.rd, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                     image_size.x, image_size.y);
+    return gfx_handler.add(std::move(tex));
+}
+
+// Replaces a part of a texture with opaque ARGB pixels, rect.w per row.
+void update_gfx(int gfx_id, SDL_Rect rect, const u32 *pixels)
+{
+    auto &tex = gfx_handler[gfx_id];
+    if (!SDL.software) {
+        SDL_UpdateTexture(tex.data, &rect, pixels, rect.w * 4);
+        return;
+    }
+    int pitch = tex.pixels->pitch / 4;
+    for (int y = 0; y < rect.h; y++)
+        copy_row((u32 *) tex.pixels->pixels + (rect.y + y) * pitch + rect.x, pixels + y * rect.w, rect.w);
+}
+
+// Copies a part of a texture on screen. src and dst must have the same size.
+void copy_texture(Texture &tex, SDL_Rect src, SDL_Rect dst)
+{
+    if (!SDL.software) {
+        SDL_RenderCopy(SDL.rd, tex.data, &src, &dst);
+        return;
+    }
+    int x1 = std::max(dst.x, 0), x2 = std::min(dst.x + dst.w, SDL.width),
+        y1 = std::max(dst.y, 0), y2 = std::min(dst.y + dst.h, SDL.height);
+    if (x1 >= x2 || y1 >= y2)
+        return;
+    auto *pixels = (const u32 *) tex.pixels->pixels;
+    int pitch = tex.pixels->pitch / 4;
+    for (int y = y1; y < y2; y++) {
+        auto *from = pixels + (src.y + y - dst.y) * pitch + src.x + x1 - dst.x;
+        auto *to   = &SDL.framebuffer[y * SDL.width + x1];
+        if (tex.opaque)
+            copy_row(to, from, x2 - x1);
+        else
+            blend_row(to, from, x2 - x1);
+    }
 }
 
 void draw_frame(vec2 pos, int gfx_id, int frame)
@@ -211,7 +236,7 @@ void draw_frame(vec2 pos, int gfx_id, int frame)
     auto &tex = gfx_handler[gfx_id];
     SDL_Rect src = { int(frame * tex.size.x), 0, int(tex.size.x), int(tex.size.y) };
     SDL_Rect dst = { int(p.x), int(p.y), int(tex.size.x), int(tex.size.y) };
-    SDL_RenderCopy(SDL.rd, tex.data, &src, &dst);
+    copy_texture(tex, src, dst);
 }
 
 void draw_character(vec2 pos, uint8_t c)
@@ -221,401 +246,400 @@ void draw_character(vec2 pos, uint8_t c)
     auto &tex = gfx_handler[TEXTURE_FONT];
     SDL_Rect src = {     x * 32,     y * 32, 32, 32 };
     SDL_Rect dst = { int(pos.x), int(pos.y), 32, 32 };
-    SDL_RenderCopy(SDL.rd, tex.data, &src, &dst);
+    copy_texture(tex, src, dst);
 }
 
 void draw_circle(vec2 pos, float radius, unsigned color)
 {
-    circle_rasterizer(pos.x, pos.y, radius, [&](float x, float y) {
-        auto [r, g, b, a] = rgba_to_components(color);
+    auto [r, g, b, a] = rgba_to_components(color);
+    if (!SDL.software)
         SDL_SetRenderDrawColor(SDL.rd, r, g, b, a);
-        SDL_RenderDrawPoint(SDL.rd, int(x), int(y));
+    u32 argb = a << 24 | r << 16 | g << 8 | b;
+    circle_rasterizer(pos.x, pos.y, radius, [&](int x1, int x2, int y) {
+        if (!SDL.software) {
+            SDL_RenderDrawLine(SDL.rd, x1, y, x2, y);
+            return;
+        }
+        x1 = std::max(x1, 0);
+        x2 = std::min(x2, SDL.width - 1);
+        if (y >= 0 && y < SDL.height && x1 <= x2)
+            fill_row(&SDL.framebuffer[y * SDL.width + x1], x2 - x1 + 1, argb);
     });
 }
 
-void draw()
+void fill_rect(SDL_Rect rect, unsigned color)
 {
-    SDL_SetRenderDrawColor(SDL.rd, 0, 0, 0, 0xff);
-    SDL_RenderClear(SDL.rd);
-    for (auto &c : board.components)
-        c->draw();
-    SDL_RenderPresent(SDL.rd);
-}
-
-} // namespace
-
-
-
-
-/* Definitions for all components */
-
-struct LED : public Component {
-    vec2 pos;
-    u32 color_min;
-    u32 color_max;
-    uint8_t val = 0;
-
-    explicit LED(vec2 pos, u32 min, u32 max) : pos{pos}, color_min{min}, color_max{max} {}
-    int  digital_read(uint8_t)                 override { return 0; }
-    void digital_write(uint8_t, uint8_t value) override
-    {
-        // This should always be safe as long user programs only use LOW and HIGH
-        val = value * 255;
-    }
-    int  analog_read(uint8_t)                  override { return 0; }
-    void analog_write(uint8_t, uint8_t value)  override { val = value; }
-    void mouse_click(vec2 mouse_pos, bool pressed)  override { }
-    void mouse_wheel(vec2 mouse_pos, bool up_or_down) override { }
-
-    void draw() override
-    {
-        draw_circle(pos + vec2{16.f, 1.6f}, 16.f, lerp_rgba(color_min, color_max, val / 255.f));
-    }
-};
-
-struct Button : public Component {
-    vec2 pos;
-    bool pressed = false;
-
-    explicit Button(vec2 pos) : pos{pos} {}
-
-    int  digital_read(uint8_t)                 override { return pressed ? HIGH : LOW; }
-    void digital_write(uint8_t, uint8_t value) override { }
-    int  analog_read(uint8_t)                  override { return 0; }
-    void analog_write(uint8_t, uint8_t value)  override { }
-    void mouse_wheel(vec2 mouse_pos, bool up_or_down) override { }
-
-    void mouse_click(vec2 mouse_pos, bool button_pressed)  override
-    {
-        bool inside = collision_rect_point({ .pos = pos, .size = {32,32} }, mouse_pos);
-        pressed = inside ? button_pressed : false;
-    }
-
-    void draw() override
-    {
-        draw_frame(pos, TEXTURE_BUTTON, int(pressed));
-    }
-};
-
-struct Potentiometer : public Component {
-    vec2 pos;
-    int value = 0;
-
-    explicit Potentiometer(vec2 pos) : pos{pos} {}
-
-    int  digital_read(uint8_t)                 override { return 0; }
-    void digital_write(uint8_t, uint8_t value) override { }
-    int  analog_read(uint8_t)                  override { return value; }
-    void analog_write(uint8_t, uint8_t value)  override { }
-    void mouse_click(vec2 mouse_pos, bool pressed)  override { }
-
-    void mouse_wheel(vec2 mouse_pos, bool up_or_down) override
-    {
-        bool inside = collision_rect_point({ .pos = pos, .size = {32,32} }, mouse_pos);
-        if (inside) {
-            value += (up_or_down ? 1 : -1) * 64;
-            value = value > 1023 ? 1023 : value < 0 ? 0 : value;
-        }
+    auto [r, g, b, a] = rgba_to_components(color);
+    if (!SDL.software) {
+        SDL_SetRenderDrawColor(SDL.rd, r, g, b, a);
+        SDL_RenderFillRect(SDL.rd, &rect);
+        return;
     }
+    int x1 = std::max(rect.x, 0), x2 = std::min(rect.x + rect.w, SDL.width),
+        y1 = std::max(rect.y, 0), y2 = std::min(rect.y + rect.h, SDL.height);
+    for (int y = y1; y < y2 && x1 < x2; y++)
+        fill_row(&SDL.framebuffer[y * SDL.width + x1], x2 - x1, a << 24 | r << 16 | g << 8 | b);
+}
 
-    void draw() override
-    {
-        draw_frame(pos, TEXTURE_POTENTIOMETER, value / 128);
-    }
+struct Span {
+    int top, bottom;
 };
 
-// struct PIR : public Component {
-//     int  digital_read()               override { return 0; }
-//     void digital_write(uint8_t value) override { }
-//     int  analog_read()                override { return 0; }
-//     void analog_write(uint8_t value)  override { }
-//     void mouse_click(vec2 mouse_pos, bool pressed)  override { }
-//     void mouse_wheel(vec2 mouse_pos, bool up_or_down) override { }
-//     void draw() override {}
-// };
-
-struct LCD : public Component {
-    vec2 pos, size;
-    uint8_t sda, scl;
-    std::vector<uint8_t> char_vec;
-    uint8_t addr = 0;
-    uint8_t buf[2] = {0, 0};
-    uint8_t idx = 0;
-    bool backlight = false;
-
-    LCD(vec2 pos, vec2 size, uint8_t addr, uint8_t sda, uint8_t scl)
-        : pos{pos}, size{size}, sda{sda}, scl{scl}
-    {
-        char_vec = std::vector(size.x * size.y, uint8_t('1'));
-        board.add_i2c(addr, [&](uint8_t val) {
-            // Receive 2 bytes (cmd, data), then handle them
-            // See comment for LiquidCrystal_I2C stuff below for details.
-            buf[idx++] = val;
-            if (idx == 2) {
-                idx = 0;
-                command(buf[0], buf[1]);
-            }
-        });
-    }
-
-    void command(uint8_t cmd, uint8_t data)
-    {
-        switch (cmd) {
-        case 0: char_vec[addr++] = data;                          break;
-        case 1: backlight = bool(data);                           break;
-        case 2: std::fill(char_vec.begin(), char_vec.end(), ' '); break;
-        case 3: addr = data;                                      break;
-        default: fmt::print(stderr, "LCD: unknown command\n");    break;
+// Draws a vertical span in each column starting from x, e.g. for a plot.
+// With SDL_Renderer, they're joined into a single line going up and down.
+void draw_spans(int x, const std::vector<Span> &spans, unsigned color)
+{
+    auto [r, g, b, a] = rgba_to_components(color);
+    if (!SDL.software) {
+        std::vector<SDL_Point> points;
+        points.reserve(spans.size() * 2);
+        for (int i = 0; i < int(spans.size()); i++) {
+            auto [top, bottom] = spans[i];
+            if (i % 2 == 1)
+                std::swap(top, bottom);
+            points.push_back({ x + i, top });
+            points.push_back({ x + i, bottom });
         }
+        SDL_SetRenderDrawColor(SDL.rd, r, g, b, a);
+        SDL_RenderDrawLines(SDL.rd, points.data(), points.size());
+        return;
     }
-
-    // Registering the LCD as a Component is useless, but we still need to occupy
-    // the pins it needs, so here we go
-    int  digital_read(uint8_t)                 override { return 0; }
-    void digital_write(uint8_t, uint8_t value) override { }
-    int  analog_read(uint8_t)                  override { return 0; }
-    void analog_write(uint8_t, uint8_t value)  override { }
-
-    void mouse_click(vec2 mouse_pos, bool pressed)  override { }
-    void mouse_wheel(vec2 mouse_pos, bool up_or_down) override { }
-
-    void draw() override
-    {
-        // Draw LCD borders
-        draw_frame(pos,                                   TEXTURE_LCD, 0);
-        draw_frame(pos + vec2{size.x+1,        0} * 32.f, TEXTURE_LCD, 1);
-        draw_frame(pos + vec2{       0, size.y+1} * 32.f, TEXTURE_LCD, 2);
-        draw_frame(pos + vec2{size.x+1, size.y+1} * 32.f, TEXTURE_LCD, 3);
-
-        for (auto i = 0u; i < size.x; i++) {
-            draw_frame(pos + vec2{i+1,        0} * 32.f, TEXTURE_LCD, 4);
-            draw_frame(pos + vec2{i+1, size.y+1} * 32.f, TEXTURE_LCD, 5);
-        }
-
-        for (auto i = 0u; i < size.y; i++) {
-            draw_frame(pos + vec2{       0, i+1} * 32.f, TEXTURE_LCD, 6);
-            draw_frame(pos + vec2{size.x+1, i+1} * 32.f, TEXTURE_LCD, 7);
-        }
-
-        // Draw LCD text
-        for (auto y = 0u; y < size.y; y++)
-            for (auto x = 0u; x < size.x; x++)
-                draw_character(pos + vec2{x+1,y+1} * 32.f, char_vec[y * size.x + x]);
+    u32 argb = a << 24 | r << 16 | g << 8 | b;
+    for (int i = 0; i < int(spans.size()); i++) {
+        if (x + i < 0 || x + i >= SDL.width)
+            continue;
+        int y1 = std::max(spans[i].top, 0), y2 = std::min(spans[i].bottom, SDL.height - 1);
+        for (int y = y1; y <= y2; y++)
+            SDL.framebuffer[y * SDL.width + x + i] = argb;
     }
-};
+}
 
+} // namespace
 
 
-/* Arduino functions, i.e. the stuff defined in the header files */
 
-HardwareSerial Serial;
+/*
+ * How each component looks. Components without a draw_component() aren't
+ * drawn at all.
+ */
 
-void HardwareSerial::begin(int n) { }
-void HardwareSerial::println(const String &msg) { printf("%s\n", msg.data()); }
-void HardwareSerial::println(const char *msg)   { printf("%s\n", msg); }
-void HardwareSerial::println(int n)             { printf("%d\n", n); }
+namespace {
 
-void pinMode(uint8_t pin, uint8_t value) { }
-int digitalRead(uint8_t pin)                  { return board.components[board.ports[pin]]->digital_read(pin); }
-int analogRead(uint8_t pin)                   { return board.components[board.ports[pin]]->analog_read(pin); }
-void digitalWrite(uint8_t pin, uint8_t value) { board.components[board.ports[pin]]->digital_write(pin, value); }
-void analogWrite(uint8_t pin, uint8_t value)  { board.components[board.ports[pin]]->analog_write(pin, value); }
+vec2 to_vec2(Point p) { return { p.x, p.y }; }
 
-unsigned long millis()
+void draw_component(LED &led)
 {
-    return SDL_GetTicks();
+    draw_circle(to_vec2(led.pos) + vec2{16.f, 1.6f}, 16.f, lerp_rgba(led.color_min, led.color_max, led.val / 255.f));
 }
 
-void delay(unsigned long ms)
+void draw_component(Button &button)
 {
-    poll();
-    draw();
-    SDL_Delay(ms);
+    draw_frame(to_vec2(button.pos), TEXTURE_BUTTON, int(button.pressed));
 }
 
-void delayMicroseconds(unsigned long us)
+void draw_component(Potentiometer &pot)
 {
-    delay(us / 1000);
+    draw_frame(to_vec2(pot.pos), TEXTURE_POTENTIOMETER, pot.value / 128);
 }
 
-// (I will implement this if I ever need to use interrupts)
-void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {}
-void detachInterrupt(uint8_t interruptNum) {}
-
-uint16_t makeWord(uint16_t w)     { return 0; }
-uint16_t makeWord(byte h, byte l) { return 0; }
-
-long random(long n)
+void draw_component(Sensor &sensor)
 {
-    return random(0, n);
+    auto color = sensor.digital ? lerp_rgba(0x400000ff, 0xff0000ff, sensor.last)
+                                : lerp_rgba(0x000040ff, 0x4040ffff, sensor.last / 1023.f);
+    draw_circle(to_vec2(sensor.pos) + vec2{16.f, 16.f}, 8.f, color);
 }
 
-long random(long a, long b)
+// The board with its two transducers, the receiver lit while ECHO is HIGH,
+// and a bar below as long as the distance (64 pixels for 4 meters).
+void draw_component(Sonar &sonar)
 {
-    return (rand() % int(b - a)) + a;
+    auto pos = to_vec2(sonar.pos);
+    fill_rect({ sonar.pos.x, sonar.pos.y, 64, 28 }, 0x2050a0ff);
+    draw_circle(pos + vec2{16.f, 14.f}, 11.f, 0xc0c0c0ff);
+    draw_circle(pos + vec2{48.f, 14.f}, 11.f, 0xc0c0c0ff);
+    draw_circle(pos + vec2{16.f, 14.f}, 7.f, 0x404040ff);
+    draw_circle(pos + vec2{48.f, 14.f}, 7.f, sonar.level ? 0x40ff40ff : 0x404040ff);
+    int bar = int(std::clamp(sonar.distance / Sonar::MAX_CM, 0.f, 1.f) * 64);
+    fill_rect({ sonar.pos.x, sonar.pos.y + 30, bar, 2 }, 0xffff40ff);
 }
 
-void randomSeed(unsigned long seed)
+// Draws each 5x8 character as 3x3 dots with 1 pixel gaps, centered in
+// a 32x32 cell like the ones in the font.
+void rasterize_glyphs(LCD &lcd)
 {
-    std::srand(seed);
+    if (lcd.glyph_gfx == -1)
+        lcd.glyph_gfx = create_gfx({32 * 8, 32}, {32, 32});
+    std::array<u32, 32*32> cell;
+    for (int i = 0; i < 8; i++) {
+        if (!(lcd.dirty_glyphs & (1 << i)))
+            continue;
+        cell.fill(0xff000000);
+        for (int row = 0; row < 8; row++)
+            for (int col = 0; col < 5; col++)
+                if (lcd.cgram[i][row] & (0x10 >> col))
+                    for (int y = 0; y < 3; y++)
+                        fill_row(&cell[(1 + row*4 + y) * 32 + 6 + col*4], 3, 0xffffffff);
+        update_gfx(lcd.glyph_gfx, { i * 32, 0, 32, 32 }, cell.data());
+    }
+    lcd.dirty_glyphs = 0;
 }
 
-long map(long x, long in_min, long in_max, long out_min, long out_max)
+void draw_component(LCD &lcd)
 {
-    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
-}
+    auto pos = to_vec2(lcd.pos), size = to_vec2(lcd.size);
 
+    // Draw LCD borders
+    draw_frame(pos,                                   TEXTURE_LCD, 0);
+    draw_frame(pos + vec2{size.x+1,        0} * 32.f, TEXTURE_LCD, 1);
+    draw_frame(pos + vec2{       0, size.y+1} * 32.f, TEXTURE_LCD, 2);
+    draw_frame(pos + vec2{size.x+1, size.y+1} * 32.f, TEXTURE_LCD, 3);
 
+    for (auto i = 0u; i < size.x; i++) {
+        draw_frame(pos + vec2{i+1,        0} * 32.f, TEXTURE_LCD, 4);
+        draw_frame(pos + vec2{i+1, size.y+1} * 32.f, TEXTURE_LCD, 5);
+    }
 
-/* String functions */
+    for (auto i = 0u; i < size.y; i++) {
+        draw_frame(pos + vec2{       0, i+1} * 32.f, TEXTURE_LCD, 6);
+        draw_frame(pos + vec2{size.x+1, i+1} * 32.f, TEXTURE_LCD, 7);
+    }
 
-String::String(int n, int base)
-{
-    start = new char[1024];
-    end = start + 1024;
-    memset(start, 0, 1024);
-    auto err = std::to_chars(start, end, n, base);
-    if (err.ec != std::errc())
-        fprintf(stderr, "warning: couldn't convert %d to string\n", n);
+    // Draw LCD text
+    if (lcd.dirty_glyphs)
+        rasterize_glyphs(lcd);
+    for (auto y = 0u; y < size.y; y++) {
+        for (auto x = 0u; x < size.x; x++) {
+            auto c = lcd.char_vec[y * lcd.size.x + x];
+            auto p = pos + vec2{x+1,y+1} * 32.f;
+            if (c < 16)
+                draw_frame(p, lcd.glyph_gfx, c & 7);
+            else
+                draw_character(p, c);
+        }
+    }
 }
 
-void String::construct(const char *s, unsigned int len)
+// The texture holds the RAM as the panel shows it before scrolling, and
+// only the pages written since the last frame go into it again. Every page
+// is 8 whole rows of it, wherever the panel's orientation puts them.
+void draw_component(OLED &oled)
 {
-    start = new char[len];
-    std::memcpy(start, s, len);
-    end = start + len;
-    end[-1] = '\0';
+    static constexpr u32 ON = 0xffa0e0ff, OFF = 0xff000000;
+    if (oled.gfx == -1)
+        oled.gfx = create_gfx({OLED::WIDTH, 64}, {OLED::WIDTH, 64});
+    std::array<u32, OLED::WIDTH * 8> rows;
+    for (int p = 0; p < OLED::PAGES; p++) {
+        if (!(oled.dirty_pages & (1 << p)))
+            continue;
+        int top = oled.row_of(p * 8) & ~7;
+        for (int x = 0; x < OLED::WIDTH; x++)
+            for (int bit = 0; bit < 8; bit++) {
+                bool on = bool(oled.ram[p][x] >> bit & 1) != oled.inverted;
+                rows[(oled.row_of(p * 8 + bit) - top) * OLED::WIDTH + oled.column_of(x)] = on ? ON : OFF;
+            }
+        update_gfx(oled.gfx, { 0, top, OLED::WIDTH, 8 }, rows.data());
+    }
+    oled.dirty_pages = 0;
+
+    int x = oled.pos.x, y = oled.pos.y, h = oled.height;
+    if (!oled.display_on || oled.all_on) {
+        fill_rect({ x, y, OLED::WIDTH, h }, oled.display_on ? 0xa0e0ffff : 0x000000ff);
+        return;
+    }
+    // the rows from scroll() on, wrapping around
+    auto &tex = gfx_handler[oled.gfx];
+    int from = oled.scroll(), first = std::min(h, 64 - from);
+    copy_texture(tex, { 0, from, OLED::WIDTH, first }, { x, y, OLED::WIDTH, first });
+    if (first < h)
+        copy_texture(tex, { 0, 0, OLED::WIDTH, h - first }, { x, y + first, OLED::WIDTH, h - first });
 }
 
-String String::concat(const char *a, size_t la, const char *b, size_t lb)
+void draw_component(Plotter &plot)
 {
-    char *r = new char[la + lb + 1];
-    std::memcpy(r, a, la);
-    std::memcpy(r + la, b, lb);
-    r[la+lb] = '\0';
-    String s;
-    s.construct(r, la+lb+1);
-    return s;
+    static constexpr u32 COLORS[Plotter::MAX_CHANNELS] = {
+        0x4080ffff, 0xff4040ff, 0x40ff40ff, 0xffff40ff,
+        0xff40ffff, 0x40ffffff, 0xff8000ff, 0xc0c0c0ff,
+    };
+    auto &rect = plot.rect;
+    auto &columns = plot.columns;
+    auto column = plot.column;
+    fill_rect({ rect.pos.x, rect.pos.y, rect.size.x, rect.size.y }, 0x202020ff);
+    auto width = columns[0].size();
+    auto n = std::min<uint64_t>(column + 1, width);
+    auto first = column + 1 - n;
+    // scaled to fit whatever is on screen
+    float lo = INFINITY, hi = -INFINITY;
+    for (int ch = 0; ch < plot.channels; ch++)
+        for (uint64_t i = first; i <= column; i++) {
+            lo = std::min(lo, columns[ch][i % width].min);
+            hi = std::max(hi, columns[ch][i % width].max);
+        }
+    if (lo > hi)
+        return;
+    if (lo == hi)
+        lo -= 1, hi += 1;
+    auto to_y = [&](float v) { return int(rect.pos.y + (hi - v) / (hi - lo) * (rect.size.y - 1)); };
+    std::vector<Span> spans;
+    for (int ch = 0; ch < plot.channels; ch++) {
+        spans.clear();
+        int x = rect.pos.x + rect.size.x - n;
+        for (uint64_t i = first; i <= column; i++) {
+            auto c = columns[ch][i % width];
+            if (c.min > c.max) {
+                // no sample there: leave a gap
+                if (!spans.empty())
+                    draw_spans(x, spans, COLORS[ch]);
+                x += spans.size() + 1;
+                spans.clear();
+                continue;
+            }
+            Span s = { to_y(c.max), to_y(c.min) };
+            // overlap the previous column, so that the line has no holes
+            if (!spans.empty()) {
+                s.top    = std::min(s.top,    spans.back().bottom);
+                s.bottom = std::max(s.bottom, spans.back().top);
+            }
+            spans.push_back(s);
+        }
+        if (!spans.empty())
+            draw_spans(x, spans, COLORS[ch]);
+    }
 }
 
+} // namespace
 
 
-/* Wire.h functions */
-
-_wire Wire;
-
-void _wire::write(uint8_t data)
-{
-    board.i2c_bus[cur_addr](data);
-}
-
 
+/*
+ * poll() is used to poll OS events, draw() draws a whole frame.
+ */
 
-/* Print.h functions */
+namespace frontend {
 
-size_t Print::write(const uint8_t *buffer, size_t size)
+void poll()
 {
-    size_t n = 0;
-    while (size--) {
-        if (write(*buffer++))
-            n++;
-        else
+    for (SDL_Event ev; SDL_PollEvent(&ev); ) {
+        switch (ev.type) {
+        case SDL_QUIT:
+            running = false;
+            exit(0);
+            break;
+        case SDL_KEYUP:
+            break;
+        case SDL_KEYDOWN:
+            // backspace goes back a second, when keeping snapshots
+            if (ev.key.keysym.sym == SDLK_BACKSPACE)
+                request_rewind(1'000'000);
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            if (ev.button.button == SDL_BUTTON_LEFT)
+                for (auto &b : boards)
+                    b.components.for_each([&]<typename T>(std::vector<T> &pool) {
+                        if constexpr (requires (T c) { c.mouse_click(Point{}, true); })
+                            for (auto &c : pool)
+                                c.mouse_click({ev.button.x, ev.button.y}, ev.button.state == SDL_PRESSED);
+                    });
+            break;
+        case SDL_MOUSEWHEEL:
+            for (auto &b : boards)
+                b.components.for_each([&]<typename T>(std::vector<T> &pool) {
+                    if constexpr (requires (T c) { c.mouse_wheel(Point{}, true); })
+                        for (auto &c : pool)
+                            c.mouse_wheel(SDL.mouse_pos, ev.wheel.y > 0);
+                });
+            break;
+        case SDL_MOUSEMOTION:
+            SDL.mouse_pos.x = ev.motion.x;
+            SDL.mouse_pos.y = ev.motion.y;
             break;
+        }
     }
-    return n;
 }
 
-
-
-/* LiquidCrystal_I2C functions */
-
-/* Technically I should be implementing and using the I2C protocol here.
- * Unfortunately, for ease of development, and because I need to finish this
- * quickly, I am not interested in doing so.
- *
- * Instead, I have implemented a very simple protocol here. The LCD will work with commands:
- * first, write the command byte, then write the data.
- * The commands for the LCD are:
- * 0: write char
- * 1: backlight
- * 2: clear
- * 3: set cursor
- */
-LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows)
-    : addr{addr}, cols{cols}, rows{rows}
-{ }
-
-void LiquidCrystal_I2C::init() {}
-
-void LiquidCrystal_I2C::command(uint8_t cmd, uint8_t data)
+void capture_frame()
 {
-    Wire.beginTransmission(addr);
-    Wire.write(cmd);
-    Wire.write(data);
-    Wire.endTransmission();
+    auto *pixels = frame_capture.acquire(SDL.width, SDL.height);
+    if (!pixels)
+        return;
+    if (SDL.software)
+        copy_row(pixels, SDL.framebuffer.data(), SDL.framebuffer.size());
+    else
+        SDL_RenderReadPixels(SDL.rd, nullptr, SDL_PIXELFORMAT_ARGB8888, pixels, SDL.width * 4);
+    frame_capture.submit();
 }
 
-void LiquidCrystal_I2C::backlight()   { command(1, 1); }
-void LiquidCrystal_I2C::noBacklight() { command(1, 0); }
-void LiquidCrystal_I2C::clear()       { command(2, 0); }
+void draw()
+{
+    SDL.clear();
+    for (auto &b : boards)
+        b.components.for_each([]<typename T>(std::vector<T> &pool) {
+            if constexpr (requires (T &c) { draw_component(c); })
+                for (auto &c : pool)
+                    draw_component(c);
+        });
+    if (frame_capture.enabled)
+        capture_frame();
+    SDL.present();
+}
 
-void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row)
+void tone(uint8_t pin, unsigned frequency, unsigned long duration)
 {
-    if (row >= rows)
-		row =  rows-1;
-    command(3, row * cols + col);
+    if (frequency == 0) {
+        if (pin != audio.tone_pin)
+            return;
+        pin = 0xff;
+    }
+    audio.tone_pin = pin;
+    audio.post({ .time = micros(), .frequency = frequency, .duration = duration });
 }
 
-size_t LiquidCrystal_I2C::write(uint8_t data)
+void quit()
 {
-    command(0, data);
-    return 1;
+    audio.close();
+    frame_capture.stop();
+    if (SDL.window)
+        SDL.quit();
 }
 
+} // namespace frontend
+
 
 
 namespace arduino_sdl {
 
 void start(const char *title, int width, int height)
 {
+    if (headless)
+        return;
     SDL.init(title, width, height);
-    std::srand(std::time(nullptr));
+    board->random_state = std::time(nullptr);
     load_gfx("button.bmp",    {32, 32});
     load_gfx("pot.bmp",       {32, 32});
     load_gfx("lcd1.bmp",      {32, 32});
     load_gfx("font.bmp",      {32, 32});
 }
 
-void loop()
+void record_audio(const char *wav_pathname)
 {
-    setup();
-    while (SDL.running) {
-        poll();
-        ::loop();
-        draw();
-    }
+    audio.record(wav_pathname);
 }
 
-void quit()
+void capture_frames(const char *pathname)
 {
-    SDL.quit();
+    frame_capture.start(pathname, SDL.width, SDL.height);
 }
 
-template <typename T>
-void connect_component(int pin, auto... args)
+void use_software_renderer()
 {
-    board.ports[pin] = board.push_component<T>(FWD(args)...);
+    SDL.software = true;
 }
 
-void connect_led(int pin, int x, int y, u32 min, u32 max) { connect_component<LED>(pin, vec2{x,y}, min, max); }
-void connect_button(int pin, int x, int y)              { connect_component<Button>(pin, vec2{x,y}); }
-void connect_potentiometer(int pin, int x, int y)       { connect_component<Potentiometer>(pin, vec2{x,y}); }
-
-void connect_lcd(uint8_t addr, uint8_t sda, uint8_t scl, int c, int r, int x, int y)
+Frame framebuffer()
 {
-    int i = board.push_component<LCD>(vec2{x, y}, vec2{c, r}, addr, sda, scl);
-    board.ports[sda] = i;
-    board.ports[scl] = i;
+    if (!SDL.software)
+        return { nullptr, 0, 0 };
+    return { SDL.framebuffer.data(), SDL.width, SDL.height };
 }
 
 } // namespace arduino_sdl
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include "arduino_string.h"
+#include "Print.h"
 
 #define HIGH 0x1
 #define LOW  0x0
@@ -59,11 +60,13 @@ const uint8_t A3 = 17;
 const uint8_t A4 = 18;
 const uint8_t A5 = 19;
 
-struct HardwareSerial {
+struct HardwareSerial : public Print {
     void begin(int baud);
-    void println(const String &msg);
-    void println(const char *msg);
-    void println(int n);
+    int available();
+    int read();
+    using Print::write;
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
 };
 
 extern HardwareSerial Serial;
@@ -76,7 +79,15 @@ void analogWrite(uint8_t pin, uint8_t val);
 //void analogReference(uint8_t mode);
 
 unsigned long millis();
+unsigned long micros();
 void delay(unsigned long ms);
+void delayMicroseconds(unsigned long us);
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration = 0);
+void noTone(uint8_t pin);
 
 void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
 void detachInterrupt(uint8_t interruptNum);
@@ -96,19 +107,144 @@ long map(long x, long in_min, long in_max, long out_min, long out_max);
 
 
 
+struct SPIDevice;
+
 namespace arduino_sdl {
 
 void start(const char *title, int width, int height);
 void loop();
 void quit();
 
+// Runs several sketches together, each on its own board, e.g. a master and
+// its slaves. Sketches must be built as shared objects, like for hot
+// reloading (see the Makefile), and only their setup() and loop() are used.
+// add_board() returns the new board's index, and makes it the current board:
+// components connected after it go on that board, until select_board().
+int add_board(const char *so_pathname);
+void select_board(int index);
+// Connects TX of each board to RX of the other.
+void link_serial(int a, int b);
+// Puts two boards on the same I2C bus. Slaves join it with Wire.begin(addr).
+void link_i2c(int a, int b);
+// Runs all boards on a shared virtual clock, as fast as possible, until it
+// gets to the given milliseconds of simulated time, or forever if 0. Can be
+// called again to carry on from there. A board in delay() lets the others
+// catch up, so sketches can wait on each other with delay() in a loop.
+void run_boards(unsigned long duration_ms = 0);
+
 enum class PinType {
     Analog, Digital
 };
 
+/*
+ * Any number of components can go on the same pin, e.g. a button and an LED
+ * showing its state, and pinMode() works like on the real board (see Net in
+ * core.h). A pin with nothing driving or pulling it reads LOW.
+ */
 void connect_led(int pin, int x, int y, unsigned color_min, unsigned color_max);
+// Connects the pin to VCC when pressed, with a resistor to ground so that it
+// reads LOW when released.
 void connect_button(int pin, int x, int y);
+// Connects the pin to ground when pressed, and nothing else: use it with
+// INPUT_PULLUP (or connect_pullup()).
+void connect_button_to_ground(int pin, int x, int y);
+void connect_pullup(int pin);
+void connect_pulldown(int pin);
 void connect_potentiometer(int pin, int x, int y);
+// Sensors replaying a recorded log in simulation time (see sensor_log.h).
+void connect_pir(int pin, const char *log_pathname, int x, int y);
+void connect_analog_sensor(int pin, const char *log_pathname, int x, int y);
+// An HC-SR04 with an obstacle distance_cm away, which the mouse wheel then
+// moves, or at the distances in a log (see sensor_log.h).
+void connect_sonar(int trig_pin, int echo_pin, int x, int y, float distance_cm = 100);
+void connect_sonar(int trig_pin, int echo_pin, const char *log_pathname, int x, int y);
 void connect_lcd(uint8_t addr, uint8_t sda, uint8_t scl, int c, int r, int x, int y);
+// An SSD1306 OLED, 128x64 or 128x32, on I2C (usually at 0x3C), or on SPI,
+// with DC HIGH for data and LOW for commands.
+void connect_oled(uint8_t addr, uint8_t sda, uint8_t scl, int x, int y, int height = 64);
+void connect_spi_oled(int cs_pin, int dc_pin, int x, int y, int height = 64);
+// Puts a device on the SPI bus (see SPI.h). The device must outlive the board.
+void connect_spi_device(int cs_pin, SPIDevice *device);
+// Plots numbers printed on Serial (as in the Arduino IDE's plotter) in a
+// w x h rectangle, one pixel column per samples_per_column lines.
+void connect_plotter(int x, int y, int w, int h, int samples_per_column = 1);
+
+// Records every pin change into a VCD file, viewable with e.g. GTKWave.
+void trace_pins(const char *vcd_pathname);
+
+// Shares the pins with other processes in POSIX shared memory, e.g.
+// share_pins("/arduino_sdl"), which can watch them and drive inputs (see
+// gpio_shm.h for the layout). With several boards, board n's segment has .n
+// appended (e.g. /arduino_sdl.1). The segments are removed at exit.
+void share_pins(const char *shm_name);
+
+// Reports every loop() taking more than budget_us (delay()s included, as
+// on a real board), listing the worst ones at exit, and warns as soon as a
+// loop() hasn't returned for stall_ms (0 turns this off).
+void monitor_loop(unsigned long budget_us, unsigned long stall_ms = 0);
+
+// Charges every Arduino call the cycles it would take on a 16MHz AVR, which
+// moves millis()/micros() forward, and prints the time spent in each function
+// at exit.
+void use_cost_model();
+
+// Changes how many cycles a call costs with the cost model, e.g.
+// set_cost("analogRead", 1790). Bytes sent are charged as "Wire byte",
+// "Serial byte" and "SPI byte".
+void set_cost(const char *function, unsigned long cycles);
+
+// Snapshots of the whole simulation: components, buses, clocks, random()
+// and, for sketches loaded as shared objects, their globals (but not what
+// they allocated, which warns when restoring). A sketch linked in keeps its
+// globals as they are. One is taken every interval_ms, between two loop()s,
+// and the last count are kept. Backspace in the window goes back a second.
+void keep_snapshots(unsigned long interval_ms, int count);
+// Goes back to the last snapshot taken at least ms ago. Returns false if
+// there's none. Called from the sketch, it only happens after the current
+// loop() (and returns true if snapshots are kept at all).
+bool rewind(unsigned long ms);
+// Snapshots kept aside, e.g. to try several what-if runs from the same
+// point (see run_boards()). Loading one forgets the periodic ones. Only
+// from main(), between run_boards() calls: from the sketch, they would
+// save or overwrite the very stack they run on, so they're refused
+// (save_snapshot() then returns -1).
+int save_snapshot();
+void load_snapshot(int id);
+
+// Copies everything played by tone() into a WAV file.
+void record_audio(const char *wav_pathname);
+
+// Runs the main() of a sketch built as a shared object, reloading the
+// sketch whenever the file changes. Used by the hot reloading host.
+int run_hot_reloadable(const char *so_pathname);
+
+// Records every frame drawn without slowing down the sketch (frames get
+// dropped instead). Writes PNG files if the pathname ends in .png, e.g.
+// "frames/%05d.png", raw RGBA otherwise. A pathname starting with '|' is a
+// command to pipe raw frames to, e.g. "| ffmpeg -f rawvideo -pix_fmt rgba
+// -s 800x600 -r 60 -i - out.mp4".
+void capture_frames(const char *pathname);
+
+// Draws everything on the CPU instead of through SDL_Renderer. Must be called
+// before start(); setting ARDUINO_SDL_RENDERER=software has the same effect.
+void use_software_renderer();
+
+// With the software renderer, the last frame drawn, as 0xAARRGGBB pixels.
+struct Frame {
+    const uint32_t *pixels;
+    int width, height;
+};
+
+Frame framebuffer();
+
+// Entry points for fuzzing, see fuzz.cpp. fuzz_init() takes the sketch's
+// main(), which is run once to connect the components, without a window.
+void fuzz_init(int (*sketch_main)());
+void fuzz_input(const uint8_t *data, size_t size);
+
+// Where EEPROM contents are kept (eeprom.bin by default). Board n, when
+// running several, gets its own file, with .n before the extension (e.g.
+// eeprom.1.bin). Must be called before the first EEPROM access.
+void eeprom_file(const char *pathname);
 
 } // namespace arduino_sdl
@@ -3,6 +3,11 @@
 #include <cstddef>
 #include <cstring>
 #include <utility>
+#include "avr/pgmspace.h"
+
+// Strings kept in flash, see avr/pgmspace.h.
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
 
 class String {
     char *start, *end;
@@ -27,6 +32,7 @@ public:
     }
 
     String(const char *s) { construct(s, strlen(s) + 1); }
+    String(const __FlashStringHelper *s) : String(reinterpret_cast<const char *>(s)) { }
     explicit String(int n, int base = 10);
 
     ~String() { delete[] start; }
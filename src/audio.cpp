@@ -0,0 +1,150 @@
+#include "audio.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+Audio audio;
+
+namespace {
+
+void write_u16(FILE *f, uint16_t n) { fputc(n & 0xff, f); fputc(n >> 8, f); }
+void write_u32(FILE *f, uint32_t n) { write_u16(f, n & 0xffff); write_u16(f, n >> 16); }
+
+void write_wav_header(FILE *f, uint32_t data_bytes)
+{
+    fwrite("RIFF", 1, 4, f);
+    write_u32(f, 36 + data_bytes);
+    fwrite("WAVEfmt ", 1, 8, f);
+    write_u32(f, 16);                           // fmt chunk size
+    write_u16(f, 1);                            // PCM
+    write_u16(f, 1);                            // mono
+    write_u32(f, Audio::SAMPLE_RATE);
+    write_u32(f, Audio::SAMPLE_RATE * 2);       // byte rate
+    write_u16(f, 2);                            // block align
+    write_u16(f, 16);                           // bits per sample
+    fwrite("data", 1, 4, f);
+    write_u32(f, data_bytes);
+}
+
+} // namespace
+
+bool Audio::open()
+{
+    if (device != 0 || failed)
+        return device != 0;
+    SDL_AudioSpec want = {};
+    want.freq     = SAMPLE_RATE;
+    want.format   = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples  = 512;
+    want.userdata = this;
+    want.callback = [](void *userdata, Uint8 *stream, int len) {
+        ((Audio *) userdata)->fill((int16_t *) stream, len / 2);
+    };
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0
+     || (device = SDL_OpenAudioDevice(nullptr, 0, &want, nullptr, 0)) == 0) {
+        fprintf(stderr, "warning: couldn't open audio device (%s), tone() will be silent\n", SDL_GetError());
+        failed = true;
+        return false;
+    }
+    SDL_PauseAudioDevice(device, 0);
+    std::atexit([] { audio.close(); });
+    return true;
+}
+
+void Audio::close()
+{
+    if (device == 0)
+        return;
+    SDL_CloseAudioDevice(device);
+    device = 0;
+    if (wav) {
+        fseek(wav, 0, SEEK_SET);
+        write_wav_header(wav, wav_bytes);
+        fclose(wav);
+        wav = nullptr;
+    }
+}
+
+void Audio::post(Command cmd)
+{
+    if (open() && !commands.push(cmd))
+        fprintf(stderr, "warning: tone queue is full, dropping command\n");
+}
+
+void Audio::record(const char *pathname)
+{
+    if (device != 0) {
+        fprintf(stderr, "warning: audio recording must be started before the first tone()\n");
+        return;
+    }
+    wav = fopen(pathname, "wb");
+    if (!wav) {
+        fprintf(stderr, "warning: couldn't open %s for writing\n", pathname);
+        return;
+    }
+    write_wav_header(wav, 0);
+    if (!open()) {
+        fclose(wav);
+        wav = nullptr;
+    }
+}
+
+uint64_t Audio::start_sample(const Command &cmd)
+{
+    auto t = int64_t(cmd.time * SAMPLE_RATE / 1'000'000);
+    // the first command ever received anchors the sketch's clock to ours
+    // (the offset is usually negative, so it can't double as the flag)
+    if (!anchored) {
+        time_offset = int64_t(pos) - t;
+        anchored = true;
+    }
+    return std::max<int64_t>(t + time_offset, 0);
+}
+
+void Audio::apply(const Command &cmd, uint64_t at)
+{
+    if (cmd.frequency == 0) {
+        step = 0;
+        end = 0;
+        return;
+    }
+    step = uint32_t((uint64_t(cmd.frequency) << 32) / SAMPLE_RATE);
+    end  = cmd.duration == 0 ? 0 : at + uint64_t(cmd.duration) * SAMPLE_RATE / 1000;
+}
+
+void Audio::fill(int16_t *out, int len)
+{
+    int i = 0;
+    while (i < len) {
+        if (!has_pending)
+            has_pending = commands.pop(pending);
+
+        // synthesize up to the next event: either a command taking effect or
+        // the current note ending
+        uint64_t next = pos + (len - i);
+        if (has_pending)
+            next = std::min(next, std::max(start_sample(pending), pos));
+        if (end != 0)
+            next = std::min(next, std::max(end, pos));
+
+        for (; pos < next; pos++, i++) {
+            out[i] = step == 0 ? 0 : phase < 0x8000'0000u ? AMPLITUDE : -AMPLITUDE;
+            phase += step;
+        }
+
+        if (end != 0 && pos >= end) {
+            step = 0;
+            end = 0;
+        }
+        if (has_pending && start_sample(pending) <= pos) {
+            apply(pending, pos);
+            has_pending = false;
+        }
+    }
+
+    if (wav) {
+        fwrite(out, 2, len, wav);
+        wav_bytes += len * 2;
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <SDL2/SDL.h>
+#include "ring.h"
+
+/*
+ * Square wave generator used by tone() and noTone(). The sketch posts
+ * commands into a lock-free queue; the SDL audio callback picks them up and
+ * synthesizes the wave. Every command carries the time it was posted at, so
+ * that notes start and stop at the right sample regardless of how big the
+ * audio buffers are.
+ * The output can also be copied to a WAV file, which works with SDL's
+ * dummy and disk drivers too (set SDL_AUDIODRIVER).
+ */
+struct Audio {
+    static constexpr int SAMPLE_RATE = 44100;
+    static constexpr int16_t AMPLITUDE = 8000;
+
+    struct Command {
+        uint64_t time;          // micros() at the time of the call
+        unsigned frequency;     // 0 means stop
+        unsigned long duration; // in milliseconds, 0 means forever
+    };
+
+    SDL_AudioDeviceID device = 0;
+    bool failed = false;
+    Ring<Command, 256> commands;
+    uint8_t tone_pin = 0xff;
+
+    // only touched by the audio callback
+    uint64_t pos = 0;                   // samples played so far
+    int64_t time_offset = 0;            // maps command times to samples
+    bool anchored = false;              // time_offset set by the first command
+    Command pending = {};
+    bool has_pending = false;
+    uint32_t phase = 0, step = 0;
+    uint64_t end = 0;                   // 0 means the current note never ends
+
+    FILE *wav = nullptr;
+    uint32_t wav_bytes = 0;
+
+    bool open();
+    void close();
+    void post(Command cmd);
+    void record(const char *pathname);
+    void fill(int16_t *out, int len);
+    void apply(const Command &cmd, uint64_t at);
+    uint64_t start_sample(const Command &cmd);
+};
+
+extern Audio audio;
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+/*
+ * There's only one address space here, so data in "flash" can be read
+ * directly. PROGMEM still puts it into a section of its own, which is how
+ * 'make footprint' tells what a sketch keeps in flash from what it keeps
+ * in RAM.
+ */
+
+#define PROGMEM __attribute__((section(".progmem.data")))
+#define PGM_P const char *
+// every PSTR() gets a section of its own: a literal in an inline function
+// lands in a COMDAT section, and GCC won't mix that with plain data (the
+// PROGMEM tables, or a PSTR() in a regular function) under one name
+#define __PGM_STR2(n) #n
+#define __PGM_STR(n) __PGM_STR2(n)
+#define PSTR(s) (__extension__({ \
+    static const char __c[] __attribute__((section(".progmem.str." __PGM_STR(__COUNTER__)))) = (s); \
+    &__c[0]; }))
+
+#define pgm_read_byte(addr)  (*(const uint8_t  *) (addr))
+#define pgm_read_word(addr)  (*(const uint16_t *) (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#define pgm_read_float(addr) (*(const float    *) (addr))
+#define pgm_read_ptr(addr)   (*(const void * const *) (addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define pgm_read_word_near(addr) pgm_read_word(addr)
+
+#define memcpy_P    memcpy
+#define memcmp_P    memcmp
+#define strlen_P    strlen
+#define strcpy_P    strcpy
+#define strncpy_P   strncpy
+#define strcat_P    strcat
+#define strcmp_P    strcmp
+#define strncmp_P   strncmp
+#define sprintf_P   sprintf
+#define snprintf_P  snprintf
@@ -0,0 +1,64 @@
+#include "blit.h"
+
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+uint32_t blend_pixel(uint32_t src, uint32_t dst)
+{
+    uint32_t a = src >> 24, ia = 255 - a;
+    uint32_t rb = ((src & 0xff00ff) * a + (dst & 0xff00ff) * ia) >> 8 & 0xff00ff;
+    uint32_t g  = ((src & 0x00ff00) * a + (dst & 0x00ff00) * ia) >> 8 & 0x00ff00;
+    return 0xff000000 | rb | g;
+}
+
+} // namespace
+
+void fill_row(uint32_t *dst, int n, uint32_t color)
+{
+    int i = 0;
+#ifdef __SSE2__
+    auto c = _mm_set1_epi32(color);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *) (dst + i), c);
+#endif
+    for (; i < n; i++)
+        dst[i] = color;
+}
+
+void copy_row(uint32_t *dst, const uint32_t *src, int n)
+{
+    // libc's memcpy is already vectorized
+    std::memcpy(dst, src, n * sizeof(uint32_t));
+}
+
+void blend_row(uint32_t *dst, const uint32_t *src, int n)
+{
+    int i = 0;
+#ifdef __SSE2__
+    auto zero   = _mm_setzero_si128();
+    auto max    = _mm_set1_epi16(255);
+    auto opaque = _mm_set1_epi32(0xff000000);
+    for (; i + 4 <= n; i += 4) {
+        auto s = _mm_loadu_si128((const __m128i *) (src + i));
+        auto d = _mm_loadu_si128((const __m128i *) (dst + i));
+        // widen to 16 bits per channel, two pixels per register
+        auto s_lo = _mm_unpacklo_epi8(s, zero), s_hi = _mm_unpackhi_epi8(s, zero);
+        auto d_lo = _mm_unpacklo_epi8(d, zero), d_hi = _mm_unpackhi_epi8(d, zero);
+        // spread each pixel's alpha over all of its channels
+        auto a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xff), 0xff);
+        auto a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xff), 0xff);
+        // s*a + d*(255-a) is at most 255*255, so it fits in 16 bits
+        auto r_lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(s_lo, a_lo),
+                                                 _mm_mullo_epi16(d_lo, _mm_sub_epi16(max, a_lo))), 8);
+        auto r_hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(s_hi, a_hi),
+                                                 _mm_mullo_epi16(d_hi, _mm_sub_epi16(max, a_hi))), 8);
+        _mm_storeu_si128((__m128i *) (dst + i), _mm_or_si128(_mm_packus_epi16(r_lo, r_hi), opaque));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = blend_pixel(src[i], dst[i]);
+}
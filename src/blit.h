@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Row primitives for the software renderer. All pixels are 32-bit ARGB.
+ * These use SSE2 where available and process four pixels at a time,
+ * since the build is unoptimized and nothing gets auto-vectorized.
+ */
+
+void fill_row(uint32_t *dst, int n, uint32_t color);
+void copy_row(uint32_t *dst, const uint32_t *src, int n);
+// alpha blends src over dst. The result is always opaque.
+void blend_row(uint32_t *dst, const uint32_t *src, int n);
@@ -0,0 +1,1368 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <cctype>
+#include <charconv>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <filesystem>
+#include <functional>
+#include <vector>
+#include <utility>
+#include <ucontext.h>
+#include "core.h"
+#include "arduino_sdl.h"
+#include "arduino_string.h"
+#include "Wire.h"
+#include "SPI.h"
+#include "Print.h"
+#include "LiquidCrystal_I2C.h"
+#include "pin_trace.h"
+#include "gpio_shm.h"
+#include "sensor_log.h"
+#include "sketch_loader.h"
+#include "ring.h"
+#include "loop_monitor.h"
+#include "cost_model.h"
+#include "snapshot.h"
+
+std::deque<ArduinoBoard> boards(1);
+ArduinoBoard *board = &boards[0];
+bool virtual_time = false;
+bool running = true;
+bool headless = false;
+
+// Every pin change goes through here, to whatever is watching the pins.
+void record_pin(uint8_t pin, bool analog, uint16_t value)
+{
+    pin_trace.record(pin, analog, value);
+    if (board->gpio.enabled)
+        board->gpio.record(pin, analog, value, micros());
+}
+
+
+
+/*
+ * Fuzzing (see arduino_sdl::fuzz_input()). The input becomes a list of
+ * events at given times, which are applied whenever the sketch lets time
+ * pass, so that they reach sketches waiting in a delay() loop too.
+ */
+
+struct FuzzEvent {
+    uint64_t time;
+    uint8_t op, arg;
+};
+
+// thrown out of the sketch once it runs past the end of the input
+struct FuzzTimeout {};
+
+// loop()s take at least a millisecond when fuzzing, so that sketches that
+// never call delay() don't need thousands of them to get anywhere
+constexpr uint64_t FUZZ_LOOP_TIME = 1000;
+
+struct {
+    bool enabled = false;
+    std::vector<uint8_t> initial;   // save_state() right after main()
+    std::vector<FuzzEvent> events;
+    std::size_t next = 0;
+    uint64_t end = 0;
+
+    void apply(FuzzEvent ev)
+    {
+        auto &buttons = board->components.get<Button>();
+        auto &pots    = board->components.get<Potentiometer>();
+        std::size_t n = ev.op / 4;
+        switch (ev.op % 4) {
+        case 1:
+            if (!buttons.empty()) {
+                auto &b = buttons[n % buttons.size()];
+                b.press(!b.pressed);
+            }
+            break;
+        case 2:
+            if (!pots.empty())
+                pots[n % pots.size()].value = ev.arg * 1023 / 255;
+            break;
+        case 3:
+            if (board->serial_in.size() < ArduinoBoard::SERIAL_BUFFER_SIZE)
+                board->serial_in.push_back(ev.arg);
+            break;
+        }
+    }
+
+    void update()
+    {
+        for ( ; next < events.size() && events[next].time <= board->now; next++)
+            apply(events[next]);
+        if (board->now > end)
+            throw FuzzTimeout{};
+    }
+} fuzzer;
+
+/*
+ * The sketch runs on a fiber (a stack of its own), so that delay() can hand
+ * control back to the main loop, which keeps handling events and drawing
+ * frames until it's time to resume the sketch.
+ */
+struct Fiber {
+    static constexpr std::size_t STACK_SIZE = 1 << 20;
+    // below where yield() finds itself, for swapcontext()'s own frame
+    static constexpr std::size_t STACK_SLACK = 1024;
+    ucontext_t host, ctx;
+    // never freed, as sketches may well call exit() while on the fiber
+    char *stack = nullptr;
+    char *sp = nullptr;     // how far down the stack was in use at the last yield()
+    bool started = false;
+    bool running = false;   // true while on the fiber
+    unsigned long wake = 0; // when to resume the sketch, in micros()
+
+    void start(void (*entry)())
+    {
+        if (!stack)
+            stack = new char[STACK_SIZE];
+        getcontext(&ctx);
+        ctx.uc_stack.ss_sp = stack;
+        ctx.uc_stack.ss_size = STACK_SIZE;
+        ctx.uc_link = &host;
+        makecontext(&ctx, entry, 0);
+        started = true;
+    }
+
+    void resume()
+    {
+        running = true;
+        swapcontext(&host, &ctx);
+        running = false;
+    }
+
+    void yield(unsigned long until)
+    {
+        wake = until;
+        sp = std::max((char *) __builtin_frame_address(0) - STACK_SLACK, stack);
+        swapcontext(&ctx, &host);
+    }
+
+    // For snapshots of a sketch stopped anywhere, e.g. in a delay(): its
+    // context and the part of the stack in use, which only make sense in
+    // this process, on this same fiber. A fiber that hadn't started yet
+    // starts over when resumed.
+    void state(StateBuffer &s)
+    {
+        s(started, wake);
+        if (!started)
+            return;
+        uint32_t used = stack + STACK_SIZE - sp;
+        s(ctx, used);
+        sp = stack + STACK_SIZE - used;
+        s(std::span<std::byte>((std::byte *) sp, used));
+    }
+} fiber;
+
+// With several boards, each one's sketch runs on a fiber of its own (see
+// arduino_sdl::run_boards()). A deque, so that fibers never move.
+std::deque<Fiber> board_fibers;
+
+namespace {
+
+// On the current board's fiber, i.e. run from run_boards() rather than from
+// fuzz_input() or main().
+bool on_board_fiber()
+{
+    return board->id < int(board_fibers.size()) && board_fibers[board->id].running;
+}
+
+// On any sketch's fiber, the one of arduino_sdl::loop() included.
+bool on_sketch_fiber()
+{
+    return fiber.running || on_board_fiber();
+}
+
+} // namespace
+
+
+
+/*
+ * Snapshots of the whole simulation (see arduino_sdl::keep_snapshots()).
+ * They're only taken and restored between loop()s, so that what's on the
+ * sketch's stack never matters. With several boards, that's only true of
+ * the one that ran last: the others may be in a delay(), so their fibers
+ * are saved too.
+ */
+
+SnapshotHistory snapshots;
+std::vector<std::vector<uint8_t>> saved_snapshots;
+// asked from the window, done after the current loop()
+uint64_t rewind_request = 0;
+
+namespace {
+
+// The time snapshots go by: with several boards, the clock of the one
+// furthest behind.
+uint64_t snapshot_clock()
+{
+    if (!virtual_time)
+        return micros();
+    uint64_t t = UINT64_MAX;
+    for (auto &b : boards)
+        t = std::min(t, b.now);
+    return t;
+}
+
+std::vector<uint8_t> save_state()
+{
+    StateBuffer s;
+    auto *cur = board;
+    for (auto &b : boards) {
+        board = &b;
+        uint64_t now = micros();
+        s(now, b);
+    }
+    board = cur;
+    // boards may be in the middle of a loop(), see run_boards()
+    s(board_fibers);
+    return std::move(s.data);
+}
+
+void load_state(std::vector<uint8_t> data)
+{
+    StateBuffer s = { .data = std::move(data), .pos = 0, .loading = true };
+    auto *cur = board;
+    for (auto &b : boards) {
+        board = &b;
+        uint64_t now;
+        s(now, b);
+        // the OS clock can't go back, so it gets an offset instead
+        if (virtual_time)
+            b.now = now;
+        else
+            b.clock_offset += int64_t(now - micros());
+        // what drives the pins may have changed, e.g. buttons let go
+        b.update_nets();
+    }
+    board = cur;
+    s(board_fibers);
+}
+
+bool rewind_snapshots(uint64_t us)
+{
+    auto now = snapshot_clock();
+    std::vector<uint8_t> state;
+    uint64_t at;
+    if (!snapshots.rewind(now > us ? now - us : 0, state, at)) {
+        fprintf(stderr, "warning: no snapshot that old\n");
+        return false;
+    }
+    load_state(std::move(state));
+    return true;
+}
+
+// Called between two loop()s.
+void snapshot_point()
+{
+    if (rewind_request) {
+        rewind_snapshots(rewind_request);
+        rewind_request = 0;
+    }
+    auto now = snapshot_clock();
+    if (snapshots.due(now))
+        snapshots.push(now, save_state());
+}
+
+// Right after taking in input, so that what's shown follows it at once.
+void update_nets()
+{
+    auto *cur = board;
+    for (auto &b : boards) {
+        board = &b;
+        b.update_nets();
+    }
+    board = cur;
+}
+
+// The sketch's side of arduino_sdl::loop(), running on the fiber.
+void run_sketch()
+{
+    auto &sketch = board->sketch;
+    sketch.setup();
+    for (;;) {
+        loop_monitor.begin_loop();
+        sketch.loop();
+        loop_monitor.end_loop();
+        // swap in a new version only between two loop()s. Its globals start
+        // out fresh, so run its setup() again.
+        if (hot_reload.enabled && hot_reload.check()) {
+            sketch = hot_reload.lib.sketch;
+            sketch.setup();
+            // the old snapshots have the old sketch's globals
+            snapshots.clear();
+        }
+        snapshot_point();
+        board->gpio.set_time(micros());
+        fiber.yield(micros());
+    }
+}
+
+// The same for each board in arduino_sdl::run_boards(), on the board's own
+// fiber. loop() can give the other boards their turn from within, see
+// delay().
+void run_board()
+{
+    auto &b = *board;
+    if (b.sketch.setup)
+        b.sketch.setup();
+    for (;;) {
+        if (b.sketch.loop)
+            b.sketch.loop();
+        b.now += LOOP_TIME;
+        board_fibers[b.id].yield(b.now);
+    }
+}
+
+} // namespace
+
+bool request_rewind(uint64_t us)
+{
+    if (!snapshots.enabled)
+        return false;
+    rewind_request = us;
+    return true;
+}
+
+
+
+/* Arduino functions, i.e. the stuff defined in the header files */
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(int n)
+{
+    // the baud rate gives the time each byte takes, see serial_send()
+    if (n <= 0) {
+        fprintf(stderr, "warning: Serial.begin(%d) ignored\n", n);
+        return;
+    }
+    board->serial_baud = n;
+}
+size_t HardwareSerial::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+namespace {
+
+// Charges the current board for a call, with the cost model on. With virtual
+// time the cycles go straight into the board's clock, otherwise micros() and
+// millis() add them to the real time.
+void charge_cycles(uint64_t cycles)
+{
+    auto before = board->cycles / CostModel::CYCLES_PER_US;
+    board->cycles += cycles;
+    if (virtual_time)
+        board->now += board->cycles / CostModel::CYCLES_PER_US - before;
+}
+
+void charge(CostModel::Function f, uint64_t n = 1)
+{
+    if (cost_model.enabled)
+        charge_cycles(cost_model.charge(f, n));
+}
+
+// Pins driven by another process (see gpio_shm.h) read as it says,
+// whatever component is there.
+bool read_driven(uint8_t pin, bool analog, int &value)
+{
+    if (!board->gpio.input(pin, value))
+        return false;
+    value = analog ? std::clamp(value, 0, 1023) : value != 0;
+    auto &p = board->gpio.shm->pins[pin];
+    if (p.value != uint32_t(value) || p.analog != analog)
+        record_pin(pin, analog, value);
+    return true;
+}
+
+// Each byte takes 10 bits (with start and stop bits) on the line, and
+// arrives only after the ones before it. write() only blocks when the TX
+// buffer is full, waiting for the oldest byte to go out.
+void serial_send(uint8_t data)
+{
+    auto now = micros();
+    auto byte_time = 10'000'000 / board->serial_baud;
+    auto start = std::max<uint64_t>(now, board->serial_busy_until);
+    board->serial_busy_until = start + byte_time;
+    if (auto *peer = board->serial_peer)
+        if (!peer->serial_rx.push({ .time = board->serial_busy_until, .data = data }))
+            fprintf(stderr, "warning: serial link full, byte lost\n");
+    if (!cost_model.enabled)
+        return;
+    charge(CostModel::SERIAL_BYTE);
+    auto backlog = board->serial_busy_until - now;
+    if (backlog > ArduinoBoard::SERIAL_BUFFER_SIZE * byte_time)
+        charge_cycles(cost_model.charge_wait(CostModel::SERIAL_BYTE,
+                                             backlog - ArduinoBoard::SERIAL_BUFFER_SIZE * byte_time));
+}
+
+} // namespace
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    // with several boards, every line says which board it comes from
+    for (size_t i = 0; i < size; i++) {
+        if (buffer[i] == '\r')
+            continue;
+        if (boards.size() > 1 && board->serial_line_start)
+            printf("[board %d] ", board->id);
+        putchar(buffer[i]);
+        board->serial_line_start = buffer[i] == '\n';
+    }
+    board->components.for_each([&]<typename T>(std::vector<T> &pool) {
+        if constexpr (requires (T c) { c.serial_write(0); })
+            for (auto &c : pool)
+                for (size_t i = 0; i < size; i++)
+                    c.serial_write(buffer[i]);
+    });
+    if (board->serial_peer || cost_model.enabled)
+        for (size_t i = 0; i < size; i++)
+            serial_send(buffer[i]);
+    return size;
+}
+
+int HardwareSerial::available()
+{
+    board->receive();
+    return board->serial_in.size();
+}
+
+int HardwareSerial::read()
+{
+    board->receive();
+    if (board->serial_in.empty())
+        return -1;
+    int data = board->serial_in.front();
+    board->serial_in.pop_front();
+    return data;
+}
+
+uint8_t ArduinoBoard::level(uint8_t pin, bool notify)
+{
+    auto &net = nets[pin];
+    auto combine = [&](int8_t &to, int level) {
+        if (level == -1)
+            return;
+        if (to != -1 && to != level && !net.warned) {
+            fprintf(stderr, "warning: short circuit on pin %d\n", pin);
+            net.warned = true;
+        }
+        // between two components driving it, LOW wins
+        to = to == -1 ? level : std::min<int>(to, level);
+    };
+    if (net.dirty) {
+        int8_t driven = -1;
+        int8_t pulled = net.mode == INPUT && net.out == HIGH ? HIGH : -1;
+        for (auto ref : net.components)
+            components.visit(ref, [&](auto &c) {
+                if constexpr (requires { c.drive(pin); })
+                    combine(driven, c.drive(pin));
+                if constexpr (requires { c.pull(pin); })
+                    if (int p = c.pull(pin); p != -1)
+                        pulled = p;
+            });
+        // the MCU wins against any component
+        if (net.mode == OUTPUT) {
+            combine(driven, net.out);
+            driven = net.out;
+        }
+        net.driven = driven;
+        net.pulled = pulled;
+        net.dirty = false;
+    }
+    int8_t level = net.driven;
+    if (net.live && net.mode != OUTPUT)
+        for (auto ref : net.components)
+            components.visit(ref, [&](auto &c) {
+                if constexpr (requires { c.digital_read(pin); })
+                    combine(level, c.digital_read(pin));
+            });
+    if (level == -1)
+        level = net.pulled == -1 ? LOW : net.pulled;
+    if (level != net.level)
+        record_pin(pin, false, level);
+    if (level != net.level || notify) {
+        net.level = level;
+        for (auto ref : net.components)
+            components.visit(ref, [&](auto &c) {
+                if constexpr (requires { c.digital_write(pin, level); })
+                    c.digital_write(pin, level);
+            });
+    }
+    return level;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    charge(CostModel::PIN_MODE);
+    if (pin >= board->nets.size())
+        return;
+    auto &net = board->nets[pin];
+    net.mode = mode == OUTPUT ? OUTPUT : INPUT;
+    if (mode != OUTPUT)
+        net.out = mode == INPUT_PULLUP ? HIGH : LOW;
+    net.dirty = true;
+    board->level(pin);
+}
+
+int digitalRead(uint8_t pin)
+{
+    charge(CostModel::DIGITAL_READ);
+    int value = 0;
+    if (read_driven(pin, false, value) || pin >= board->nets.size())
+        return value;
+    return board->level(pin);
+}
+
+// Pins without anything analog read as their digital level.
+int analogRead(uint8_t pin)
+{
+    charge(CostModel::ANALOG_READ);
+    int value = -1;
+    if (read_driven(pin, true, value) || pin >= board->nets.size())
+        return std::max(value, 0);
+    board->visit_pin(pin, [&](auto &c) {
+        if constexpr (requires { c.analog_read(pin); })
+            if (value == -1)
+                value = c.analog_read(pin);
+    });
+    return value != -1 ? value : board->level(pin) ? 1023 : 0;
+}
+
+// Pins that aren't OUTPUT still get their pull-up turned on and off, like
+// on AVR, which is just as well for sketches that forgot pinMode().
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    charge(CostModel::DIGITAL_WRITE);
+    if (pin >= board->nets.size())
+        return;
+    auto &net = board->nets[pin];
+    net.out = value != LOW;
+    net.dirty = true;
+    board->level(pin, net.mode == OUTPUT);
+}
+
+// Makes the pin an OUTPUT, like the real one. Those reading it digitally
+// see HIGH from 128 on.
+void analogWrite(uint8_t pin, uint8_t value)
+{
+    charge(CostModel::ANALOG_WRITE);
+    if (pin >= board->nets.size())
+        return;
+    auto &net = board->nets[pin];
+    net.mode = OUTPUT;
+    net.out = value >= 128;
+    net.dirty = true;
+    board->level(pin, true);
+    board->visit_pin(pin, [&](auto &c) {
+        if constexpr (requires { c.analog_write(pin, value); })
+            c.analog_write(pin, value);
+    });
+    record_pin(pin, true, value);
+}
+
+unsigned long millis()
+{
+    return micros() / 1000;
+}
+
+unsigned long micros()
+{
+    if (virtual_time)
+        return board->now;
+    using namespace std::chrono;
+    static auto start = steady_clock::now();
+    return duration_cast<microseconds>(steady_clock::now() - start).count()
+         + board->cycles / CostModel::CYCLES_PER_US + board->clock_offset;
+}
+
+namespace {
+
+// Time passing in delay() with virtual time. With several boards, the
+// others get to run until they catch up (see arduino_sdl::run_boards()), so
+// that a sketch can wait for something they send, e.g. with
+// while (!Serial.available()) delay(1);
+// Otherwise the board just skips ahead, taking in what arrived meanwhile.
+void virtual_delay(uint64_t us)
+{
+    board->now += us;
+    if (on_board_fiber()) {
+        board_fibers[board->id].yield(board->now);
+        return;
+    }
+    board->receive();
+    if (fuzzer.enabled)
+        fuzzer.update();
+}
+
+} // namespace
+
+void delay(unsigned long ms)
+{
+    if (virtual_time) {
+        virtual_delay(ms * 1000);
+        return;
+    }
+    if (fiber.running) {
+        fiber.yield(micros() + ms * 1000);
+        return;
+    }
+    // not called from the sketch's fiber, e.g. from main()
+    frontend::poll();
+    update_nets();
+    frontend::draw();
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned long us)
+{
+    if (virtual_time) {
+        virtual_delay(us);
+        return;
+    }
+    delay(us / 1000);
+}
+
+namespace {
+
+// Time passing while the sketch waits on something whose outcome is already
+// known, so that nothing needs to run meanwhile.
+void skip_time(uint64_t us)
+{
+    if (virtual_time) {
+        board->now += us;
+        board->receive();
+        if (fuzzer.enabled)
+            fuzzer.update();
+    } else
+        board->clock_offset += us;
+}
+
+} // namespace
+
+// Components that make pulses say up front how wide the next one is, and
+// the time it takes is skipped over. Pins that don't (or are driven by
+// another process) never change, so they always time out.
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout)
+{
+    unsigned long width = 0;
+    uint64_t wait = timeout;
+    int value;
+    if (!read_driven(pin, false, value))
+        board->visit_pin(pin, [&](auto &c) {
+            if constexpr (requires { c.pulse_in(pin, state, timeout, wait); })
+                width = c.pulse_in(pin, state, timeout, wait);
+        });
+    if (width == 0) {
+        skip_time(wait);
+        return 0;
+    }
+    skip_time(wait - width);
+    record_pin(pin, false, state);
+    skip_time(width);
+    record_pin(pin, false, !state);
+    return width;
+}
+
+unsigned long pulseInLong(uint8_t pin, uint8_t state, unsigned long timeout)
+{
+    return pulseIn(pin, state, timeout);
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration)
+{
+    if (frequency > 0)
+        frontend::tone(pin, frequency, duration);
+}
+
+void noTone(uint8_t pin)
+{
+    frontend::tone(pin, 0, 0);
+}
+
+// (I will implement this if I ever need to use interrupts)
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {}
+void detachInterrupt(uint8_t interruptNum) {}
+
+uint16_t makeWord(uint16_t w)     { return 0; }
+uint16_t makeWord(byte h, byte l) { return 0; }
+
+long random(long n)
+{
+    return random(0, n);
+}
+
+long random(long a, long b)
+{
+    if (a >= b)
+        return a;
+    // Park-Miller, as in avr-libc, so that a seed gives the same numbers as
+    // on the board
+    int32_t x = board->random_state ? board->random_state : 123459876;
+    x = 16807 * (x % 127773) - 2836 * (x / 127773);
+    if (x < 0)
+        x += 0x7fffffff;
+    board->random_state = x;
+    return x % (b - a) + a;
+}
+
+void randomSeed(unsigned long seed)
+{
+    if (seed != 0)
+        board->random_state = seed;
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+
+
+/* String functions */
+
+String::String(int n, int base)
+{
+    start = new char[1024];
+    end = start + 1024;
+    memset(start, 0, 1024);
+    auto err = std::to_chars(start, end, n, base);
+    if (err.ec != std::errc())
+        fprintf(stderr, "warning: couldn't convert %d to string\n", n);
+}
+
+void String::construct(const char *s, unsigned int len)
+{
+    start = new char[len];
+    std::memcpy(start, s, len);
+    end = start + len;
+    end[-1] = '\0';
+}
+
+String String::concat(const char *a, size_t la, const char *b, size_t lb)
+{
+    char *r = new char[la + lb + 1];
+    std::memcpy(r, a, la);
+    std::memcpy(r + la, b, lb);
+    r[la+lb] = '\0';
+    String s;
+    s.construct(r, la+lb+1);
+    return s;
+}
+
+
+
+/* Wire.h functions */
+
+_wire Wire;
+
+void _wire::begin(uint8_t addr)
+{
+    cur_addr = 0;
+    board->wire_addr = addr;
+}
+
+void _wire::write(uint8_t data)
+{
+    charge(CostModel::WIRE_BYTE);
+    // devices on the board get their bytes right away, other boards get the
+    // whole message at endTransmission()
+    if (auto it = board->i2c_bus.find(cur_addr); it != board->i2c_bus.end())
+        it->second(data);
+    else if (board->wire_out.size() < I2CMessage::MAX_SIZE)
+        board->wire_out.push_back(data);
+}
+
+uint8_t _wire::endTransmission()
+{
+    charge(CostModel::WIRE_BYTE); // the address
+    bool found = board->i2c_bus.contains(cur_addr);
+    if (auto it = board->i2c_end.find(cur_addr); it != board->i2c_end.end())
+        it->second();
+    if (!board->wire_out.empty()) {
+        // at 100kHz, 9 bits for each byte plus the address. The cost
+        // model already charged the bytes as they were written.
+        auto size = board->wire_out.size();
+        auto arrival = cost_model.enabled ? board->now : board->now + (size + 1) * 90;
+        I2CMessage m = { .time = arrival, .size = uint8_t(size), .data = {} };
+        std::copy(board->wire_out.begin(), board->wire_out.end(), m.data);
+        for (auto *peer : board->i2c_peers) {
+            if (peer->wire_addr != cur_addr)
+                continue;
+            found = true;
+            if (!peer->i2c_rx.push(m))
+                fprintf(stderr, "warning: I2C link full, message lost\n");
+        }
+        board->wire_out.clear();
+        // the master waits for the transfer to finish
+        if (virtual_time)
+            board->now = arrival;
+    }
+    cur_addr = 0;
+    return found ? 0 : 2; // 2 = NACK on the address
+}
+
+int _wire::available()
+{
+    return board->wire_in.size();
+}
+
+int _wire::read()
+{
+    if (board->wire_in.empty())
+        return -1;
+    int data = board->wire_in.front();
+    board->wire_in.pop_front();
+    return data;
+}
+
+void _wire::onReceive(void (*handler)(int))
+{
+    board->on_receive = handler;
+}
+
+
+
+/* SPI.h functions */
+
+SPIClass SPI;
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    transfer(&data, 1);
+    return data;
+}
+
+uint16_t SPIClass::transfer16(uint16_t data)
+{
+    bool msb = settings.bit_order == MSBFIRST;
+    uint8_t buf[2] = { uint8_t(msb ? data >> 8 : data), uint8_t(msb ? data : data >> 8) };
+    transfer(buf, 2);
+    return msb ? buf[0] << 8 | buf[1] : buf[1] << 8 | buf[0];
+}
+
+void SPIClass::transfer(void *buf, size_t count)
+{
+    // The whole buffer goes to the selected devices at once, each getting
+    // its own copy of what was sent, and spi_transfer() returning whether
+    // it answered. With several answering, MISO reads as the AND of their
+    // answers, as if they could only pull it low. If none does, MISO is
+    // left high and every byte reads 0xFF, like on a bus with nothing on it.
+    static std::vector<uint8_t> sent, reply;
+    static bool warned = false;
+    charge(CostModel::SPI_BYTE, count);
+    auto data = std::span<uint8_t>((uint8_t *) buf, count);
+    sent.assign(data.begin(), data.end());
+    int answers = 0;
+    board->components.for_each([&]<typename T>(std::vector<T> &pool) {
+        if constexpr (requires (T c) { c.spi_transfer(data); })
+            for (auto &c : pool) {
+                reply = sent;
+                if (!c.spi_transfer(reply))
+                    continue;
+                for (size_t i = 0; i < count; i++)
+                    data[i] = answers == 0 ? reply[i] : data[i] & reply[i];
+                answers++;
+            }
+    });
+    if (answers == 0)
+        std::fill(data.begin(), data.end(), 0xff);
+    if (answers > 1 && !warned) {
+        fprintf(stderr, "warning: %d SPI devices answering at once, MISO reads as the AND of their answers\n", answers);
+        warned = true;
+    }
+}
+
+
+
+/* Print.h functions */
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--) {
+        if (write(*buffer++))
+            n++;
+        else
+            break;
+    }
+    return n;
+}
+
+namespace {
+
+template <typename T>
+size_t print_number(Print &out, T n, int base)
+{
+    // big enough for 64 bits in binary
+    char buf[64];
+    if (base < 2 || base > 36)
+        base = DEC;
+    // like on Arduino, only decimal numbers get a sign
+    auto res = base == DEC ? std::to_chars(buf, buf + sizeof(buf), n)
+                           : std::to_chars(buf, buf + sizeof(buf), std::make_unsigned_t<T>(n), base);
+    for (auto *p = buf; p != res.ptr; p++)
+        *p = std::toupper(*p);
+    return out.write((const uint8_t *) buf, res.ptr - buf);
+}
+
+} // namespace
+
+size_t Print::print(int n, int base)                { return print_number(*this, n, base); }
+size_t Print::print(unsigned int n, int base)       { return print_number(*this, n, base); }
+size_t Print::print(long n, int base)               { return print_number(*this, n, base); }
+size_t Print::print(unsigned long n, int base)      { return print_number(*this, n, base); }
+size_t Print::print(long long n, int base)          { return print_number(*this, n, base); }
+size_t Print::print(unsigned long long n, int base) { return print_number(*this, n, base); }
+
+size_t Print::print(double n, int digits)
+{
+    // same limits as Arduino's
+    if (std::isnan(n))                         return print("nan");
+    if (std::isinf(n))                         return print("inf");
+    if (n > 4294967040.0 || n < -4294967040.0) return print("ovf");
+    char buf[64];
+    auto res = std::to_chars(buf, buf + sizeof(buf), n, std::chars_format::fixed, std::clamp(digits, 0, 40));
+    return write((const uint8_t *) buf, res.ptr - buf);
+}
+
+
+
+/* LiquidCrystal_I2C functions */
+
+/* Technically I should be implementing and using the I2C protocol here.
+ * Unfortunately, for ease of development, and because I need to finish this
+ * quickly, I am not interested in doing so.
+ *
+ * Instead, I have implemented a very simple protocol here. The LCD will work with commands:
+ * first, write the command byte, then write the data.
+ * The commands for the LCD are:
+ * 0: write char
+ * 1: backlight
+ * 2: clear
+ * 3: set cursor
+ * 4: set custom character (CGRAM) address, data is the character (0-7)
+ * 5: write the next row of the custom character, the low 5 bits are its pixels
+ */
+LiquidCrystal_I2C::LiquidCrystal_I2C(uint8_t addr, uint8_t cols, uint8_t rows)
+    : addr{addr}, cols{cols}, rows{rows}
+{ }
+
+void LiquidCrystal_I2C::init() {}
+
+void LiquidCrystal_I2C::command(uint8_t cmd, uint8_t data)
+{
+    Wire.beginTransmission(addr);
+    Wire.write(cmd);
+    Wire.write(data);
+    Wire.endTransmission();
+}
+
+void LiquidCrystal_I2C::backlight()   { command(1, 1); }
+void LiquidCrystal_I2C::noBacklight() { command(1, 0); }
+void LiquidCrystal_I2C::clear()       { command(2, 0); }
+
+void LiquidCrystal_I2C::setCursor(uint8_t col, uint8_t row)
+{
+    if (row >= rows)
+		row =  rows-1;
+    command(3, row * cols + col);
+}
+
+void LiquidCrystal_I2C::createChar(uint8_t location, const uint8_t charmap[])
+{
+    command(4, location);
+    for (int i = 0; i < 8; i++)
+        command(5, charmap[i]);
+}
+
+size_t LiquidCrystal_I2C::write(uint8_t data)
+{
+    command(0, data);
+    return 1;
+}
+
+namespace arduino_sdl {
+
+void loop()
+{
+    // when fuzzing, the sketch's main() is only run to connect components
+    if (fuzzer.enabled)
+        return;
+    // The sketch runs until it calls delay() or its loop() returns, then
+    // the frontend is kept up to date until the sketch must resume. Frames
+    // are drawn at most FRAME_TIME apart, however often loop() runs.
+    constexpr unsigned long FRAME_TIME = 1'000'000 / 60;
+    fiber.start(run_sketch);
+    unsigned long next_frame = 0;
+    while (running) {
+        frontend::poll();
+        update_nets();
+        if (micros() >= fiber.wake)
+            fiber.resume();
+        auto now = micros();
+        // (the clock goes back when rewinding)
+        if (now >= next_frame || next_frame > now + FRAME_TIME) {
+            frontend::draw();
+            next_frame = now + FRAME_TIME;
+        }
+        now = micros();
+        auto until = std::min(fiber.wake, next_frame);
+        if (until > now + 1000)
+            std::this_thread::sleep_for(std::chrono::microseconds(until - now));
+    }
+}
+
+/*
+ * Fuzzing. Each input is read two bytes at a time, an operation and its
+ * argument, each happening FUZZ_STEP after the one before:
+ *  op % 4 == 0: nothing, but wait arg * 100ms more
+ *  op % 4 == 1: toggle button number op / 4 (modulo the number of buttons)
+ *  op % 4 == 2: set potentiometer number op / 4 to arg (scaled to 0-1023)
+ *  op % 4 == 3: receive arg on Serial
+ * Before each input, the whole board (components, pins, buses, random()...)
+ * and the EEPROM are put back as they were after main() and setup() is run
+ * again. Nothing written to the EEPROM
+ * reaches its file. The sketch's own globals are left alone, so setup()
+ * must initialize whatever state matters. The run ends one second
+ * after the last event, even in the middle of a loop().
+ */
+void fuzz_init(int (*sketch_main)())
+{
+    fuzzer.enabled = true;
+    headless = true;
+    virtual_time = true;
+    eeprom_copy_on_write();
+    sketch_main();
+    fuzzer.initial = save_state();
+}
+
+void fuzz_input(const uint8_t *data, size_t size)
+{
+    constexpr uint64_t FUZZ_STEP = 20'000;
+    // the clock goes back to 0 too (with virtual time, clock_offset is
+    // never used)
+    load_state(fuzzer.initial);
+    eeprom_reset();
+
+    fuzzer.events.clear();
+    fuzzer.next = 0;
+    uint64_t t = 0;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        t += FUZZ_STEP;
+        if (data[i] % 4 == 0)
+            t += data[i+1] * 100'000;
+        else
+            fuzzer.events.push_back({ .time = t, .op = data[i], .arg = data[i+1] });
+    }
+    fuzzer.end = t + 1'000'000;
+
+    // loop()s take at least a millisecond here, so that sketches that never
+    // call delay() don't need thousands of them to get anywhere
+    try {
+        board->sketch.setup();
+        for (;;) {
+            fuzzer.update();
+            board->sketch.loop();
+            board->now += FUZZ_LOOP_TIME;
+        }
+    } catch (FuzzTimeout) { }
+}
+
+namespace {
+
+// Set by share_pins(). Board 0's segment gets this name, board n's the same
+// with .n appended, e.g. /arduino_sdl.1.
+std::string shm_name;
+
+void share_board_pins(ArduinoBoard &b)
+{
+    auto name = b.id == 0 ? shm_name : shm_name + "." + std::to_string(b.id);
+    b.gpio.start(name.c_str());
+}
+
+} // namespace
+
+int add_board(const char *so_pathname)
+{
+    SketchLibrary lib;
+    if (!lib.load_copy(so_pathname)) {
+        fprintf(stderr, "error: couldn't load sketch %s\n", so_pathname);
+        return -1;
+    }
+    // the first board is only taken when no sketch was linked in
+    if (boards.size() > 1 || boards[0].sketch.loop)
+        boards.emplace_back();
+    board = &boards.back();
+    board->id = boards.size() - 1;
+    board->sketch = lib.sketch;
+    if (!shm_name.empty())
+        share_board_pins(*board);
+    return boards.size() - 1;
+}
+
+void select_board(int index)
+{
+    board = &boards[index];
+}
+
+void link_serial(int a, int b)
+{
+    boards[a].serial_peer = &boards[b];
+    boards[b].serial_peer = &boards[a];
+}
+
+void link_i2c(int a, int b)
+{
+    boards[a].i2c_peers.push_back(&boards[b]);
+    boards[b].i2c_peers.push_back(&boards[a]);
+}
+
+/*
+ * Boards run in lockstep: the board whose clock is furthest behind always
+ * goes next, for one loop() or until it calls delay(). As the others are all
+ * ahead of it, anything they send it until its clock has already been sent.
+ * A sketch busy-waiting without any delay() still keeps the others from
+ * running, until its loop() returns.
+ */
+void run_boards(unsigned long duration_ms)
+{
+    constexpr uint64_t FRAME_TIME = 1'000'000 / 60;
+    virtual_time = true;
+    // run_boards() may be called again to carry on, e.g. after a rewind,
+    // with the sketches where they were
+    board_fibers.resize(boards.size());
+    uint64_t end = uint64_t(duration_ms) * 1000, next_frame = 0;
+    while (running) {
+        snapshot_point();
+        auto *next = &boards[0];
+        for (auto &b : boards)
+            if (b.now < next->now)
+                next = &b;
+        if (end && next->now >= end)
+            break;
+        // frames follow the virtual clock too, so that what's on screen
+        // matches the sketches, however fast they're running
+        if (next->now >= next_frame || next_frame > next->now + FRAME_TIME) {
+            frontend::poll();
+            update_nets();
+            frontend::draw();
+            next_frame = next->now + FRAME_TIME;
+        }
+        board = next;
+        board->receive();
+        auto &f = board_fibers[board->id];
+        if (!f.started)
+            f.start(run_board);
+        f.resume();
+        board->gpio.set_time(board->now);
+    }
+}
+
+void quit()
+{
+    pin_trace.stop();
+    for (auto &b : boards)
+        b.gpio.stop();
+    loop_monitor.stop();
+    frontend::quit();
+}
+
+void trace_pins(const char *vcd_pathname)
+{
+    pin_trace.start(vcd_pathname);
+}
+
+void share_pins(const char *name)
+{
+    if (!shm_name.empty())
+        return;
+    shm_name = name;
+    for (auto &b : boards)
+        share_board_pins(b);
+    std::atexit([] {
+        for (auto &b : boards)
+            b.gpio.stop();
+    });
+}
+
+void monitor_loop(unsigned long budget_us, unsigned long stall_ms)
+{
+    loop_monitor.start(budget_us, stall_ms);
+}
+
+void keep_snapshots(unsigned long interval_ms, int count)
+{
+    snapshots.start(interval_ms * 1000, count);
+}
+
+namespace {
+
+// Snapshots are only taken and loaded between loop()s, with the sketch's
+// stack out of the way (see snapshot_point()), so not from the sketch.
+bool from_sketch(const char *what)
+{
+    if (!on_sketch_fiber())
+        return false;
+    fprintf(stderr, "warning: %s() called from the sketch, ignored\n", what);
+    return true;
+}
+
+} // namespace
+
+bool rewind(unsigned long ms)
+{
+    // that one can wait for the end of the loop()
+    if (on_sketch_fiber())
+        return request_rewind(uint64_t(ms) * 1000);
+    return rewind_snapshots(uint64_t(ms) * 1000);
+}
+
+int save_snapshot()
+{
+    if (from_sketch("save_snapshot"))
+        return -1;
+    saved_snapshots.push_back(save_state());
+    return saved_snapshots.size() - 1;
+}
+
+void load_snapshot(int id)
+{
+    if (from_sketch("load_snapshot"))
+        return;
+    load_state(saved_snapshots[id]);
+    // what comes after it is another story now
+    snapshots.clear();
+}
+
+void use_cost_model()
+{
+    cost_model.start();
+}
+
+void set_cost(const char *function, unsigned long cycles)
+{
+    cost_model.set(function, cycles);
+}
+
+int run_hot_reloadable(const char *so_pathname)
+{
+    if (!hot_reload.start(so_pathname) || !hot_reload.lib.sketch.main) {
+        fprintf(stderr, "error: couldn't run sketch %s\n", so_pathname);
+        return 1;
+    }
+    board->sketch = hot_reload.lib.sketch;
+    return board->sketch.main();
+}
+
+template <typename T>
+ComponentRef connect_component(int pin, auto... args)
+{
+    auto ref = board->components.add<T>(FWD(args)...);
+    board->attach(pin, ref);
+    return ref;
+}
+
+void connect_led(int pin, int x, int y, u32 min, u32 max) { connect_component<LED>(pin, Point{x, y}, min, max); }
+void connect_potentiometer(int pin, int x, int y)       { connect_component<Potentiometer>(pin, Point{x, y}, pin); }
+void connect_pullup(int pin)                            { connect_component<PullResistor>(pin, uint8_t(HIGH)); }
+void connect_pulldown(int pin)                          { connect_component<PullResistor>(pin, uint8_t(LOW)); }
+
+void add_button(int pin, int x, int y, bool to_ground)
+{
+    auto ref = connect_component<Button>(pin, Point{x, y}, pin, to_ground);
+    board->components.get<Button>()[ref.index].net_dirty = &board->nets[pin].dirty;
+}
+
+void connect_button(int pin, int x, int y)
+{
+    // with the usual resistor to ground, so it reads LOW when released
+    add_button(pin, x, y, false);
+    connect_pulldown(pin);
+}
+
+void connect_button_to_ground(int pin, int x, int y)
+{
+    add_button(pin, x, y, true);
+}
+
+void connect_pir(int pin, const char *log_pathname, int x, int y)
+{
+    connect_component<Sensor>(pin, Point{x, y}, pin, true, log_pathname);
+}
+
+void connect_analog_sensor(int pin, const char *log_pathname, int x, int y)
+{
+    connect_component<Sensor>(pin, Point{x, y}, pin, false, log_pathname);
+}
+
+void connect_sonar(int trig_pin, int echo_pin, int x, int y, float distance_cm)
+{
+    auto ref = board->components.add<Sonar>(Point{x, y}, trig_pin, echo_pin, distance_cm, nullptr);
+    board->attach(trig_pin, ref);
+    board->attach(echo_pin, ref);
+}
+
+void connect_sonar(int trig_pin, int echo_pin, const char *log_pathname, int x, int y)
+{
+    auto ref = board->components.add<Sonar>(Point{x, y}, trig_pin, echo_pin, 0.f, log_pathname);
+    board->attach(trig_pin, ref);
+    board->attach(echo_pin, ref);
+}
+
+void connect_spi_device(int cs_pin, SPIDevice *device)
+{
+    connect_component<SPIChipSelect>(cs_pin, device);
+}
+
+void connect_plotter(int x, int y, int w, int h, int samples_per_column)
+{
+    board->components.add<Plotter>(Rect{ .pos = {x, y}, .size = {w, h} }, samples_per_column);
+}
+
+void connect_lcd(uint8_t addr, uint8_t sda, uint8_t scl, int c, int r, int x, int y)
+{
+    // the LCD doesn't use its pins, but still occupies them
+    auto ref = board->components.add<LCD>(Point{x, y}, Point{c, r}, addr, sda, scl);
+    board->attach(sda, ref);
+    board->attach(scl, ref);
+    board->add_i2c(addr, [b = board, i = ref.index](uint8_t val) {
+        b->components.get<LCD>()[i].receive(val);
+    });
+}
+
+void connect_oled(uint8_t addr, uint8_t sda, uint8_t scl, int x, int y, int height)
+{
+    auto ref = board->components.add<OLED>(Point{x, y}, height);
+    board->attach(sda, ref);
+    board->attach(scl, ref);
+    board->add_i2c(addr, [b = board, i = ref.index](uint8_t val) {
+        b->components.get<OLED>()[i].i2c_receive(val);
+    });
+    board->i2c_end[addr] = [b = board, i = ref.index] {
+        b->components.get<OLED>()[i].i2c_end();
+    };
+}
+
+void connect_spi_oled(int cs_pin, int dc_pin, int x, int y, int height)
+{
+    auto ref = board->components.add<OLED>(Point{x, y}, height);
+    auto &oled = board->components.get<OLED>()[ref.index];
+    oled.cs = cs_pin;
+    oled.dc = dc_pin;
+    board->attach(cs_pin, ref);
+    board->attach(dc_pin, ref);
+}
+
+} // namespace arduino_sdl
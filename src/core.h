@@ -0,0 +1,847 @@
+#pragma once
+
+/*
+ * The emulation itself: boards, their pins and components, the buses between
+ * them and the clock, without anything about showing them. Only used inside
+ * the library: sketches only see arduino_sdl.h.
+ * A frontend (arduino_sdl.cpp for SDL, headless.cpp for nothing at all)
+ * shows the boards and takes input, see the frontend namespace below.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ring.h"
+#include "sensor_log.h"
+#include "sketch_loader.h"
+#include "snapshot.h"
+#include "gpio_shm.h"
+// last, as it defines abs() and round() as macros
+#include "arduino_sdl.h"
+#include "SPI.h"
+
+#define FWD(...) std::forward<decltype(__VA_ARGS__)>(__VA_ARGS__)
+
+using u32 = uint32_t;
+
+// Where components are, in window pixels. Only frontends care, and the
+// mouse handlers below.
+struct Point {
+    int x, y;
+};
+
+struct Rect {
+    Point pos;
+    Point size;
+};
+
+inline bool collision_rect_point(Rect r, Point p)
+{
+    return p.x >= r.pos.x && p.x <= r.pos.x + r.size.x
+        && p.y >= r.pos.y && p.y <= r.pos.y + r.size.y;
+}
+
+void record_pin(uint8_t pin, bool analog, uint16_t value);
+
+// Weak, so that the library can also be linked without a sketch, which
+// then gets loaded at runtime instead (see sketch_loader.h).
+__attribute__((weak)) void setup();
+__attribute__((weak)) void loop();
+
+
+
+/*
+ * Definitions for all components.
+ * all these classes are intentionally written to have as few methods
+ * as possible: a component only defines the methods it needs, so that
+ * e.g. pin reads and writes on components without any effect do nothing,
+ * and mouse events only reach the components that handle them. Something
+ * missing is simply detected at compile time (see ComponentPools).
+ */
+
+struct LED {
+    Point pos;
+    u32 color_min;
+    u32 color_max;
+    uint8_t val = 0;
+
+    explicit LED(Point pos, u32 min, u32 max) : pos{pos}, color_min{min}, color_max{max} {}
+    void digital_write(uint8_t, uint8_t value)
+    {
+        // This should always be safe as long user programs only use LOW and HIGH
+        val = value * 255;
+    }
+    void analog_write(uint8_t, uint8_t value) { val = value; }
+    void state(StateBuffer &s) { s(val); }
+};
+
+// Connects its pin to VCC (or to ground) while pressed, and leaves it
+// alone otherwise: something else has to pull it the other way.
+struct Button {
+    Point pos;
+    uint8_t pin;
+    bool to_ground;
+    bool pressed = false;
+    bool *net_dirty = nullptr;  // its net's, see Net
+
+    explicit Button(Point pos, uint8_t pin, bool to_ground) : pos{pos}, pin{pin}, to_ground{to_ground} {}
+
+    int drive(uint8_t) { return !pressed ? -1 : to_ground ? LOW : HIGH; }
+    void state(StateBuffer &s)
+    {
+        s(pressed);
+        if (s.loading && net_dirty)
+            *net_dirty = true;
+    }
+
+    void press(bool p)
+    {
+        if (p != pressed) {
+            pressed = p;
+            *net_dirty = true;
+        }
+    }
+
+    void mouse_click(Point mouse_pos, bool button_pressed)
+    {
+        bool inside = collision_rect_point({ .pos = pos, .size = {32,32} }, mouse_pos);
+        press(inside ? button_pressed : false);
+    }
+};
+
+// A resistor from a pin to VCC (HIGH) or to ground (LOW).
+struct PullResistor {
+    uint8_t to;
+
+    explicit PullResistor(uint8_t to) : to{to} {}
+    int pull(uint8_t) { return to; }
+};
+
+struct Potentiometer {
+    Point pos;
+    uint8_t pin;
+    int value = 0;
+
+    explicit Potentiometer(Point pos, uint8_t pin) : pos{pos}, pin{pin} {}
+
+    int analog_read(uint8_t) { return value; }
+    void state(StateBuffer &s) { s(value); }
+
+    void mouse_wheel(Point mouse_pos, bool up_or_down)
+    {
+        bool inside = collision_rect_point({ .pos = pos, .size = {32,32} }, mouse_pos);
+        if (inside) {
+            value += (up_or_down ? 1 : -1) * 64;
+            value = value > 1023 ? 1023 : value < 0 ? 0 : value;
+            record_pin(pin, true, value);
+        }
+    }
+};
+
+// A sensor (PIR, temperature, ...) replaying a recorded log instead of
+// being controlled by the mouse. Digital sensors read as HIGH whenever the
+// log's value is non-zero, analog ones return the value clamped to 0-1023.
+struct Sensor {
+    Point pos;
+    uint8_t pin;
+    bool digital;
+    SensorLog log;
+    int last = 0;
+
+    Sensor(Point pos, uint8_t pin, bool digital, const char *pathname)
+        : pos{pos}, pin{pin}, digital{digital}, log{pathname}
+    { }
+
+    int read()
+    {
+        auto t = millis();
+        int value = digital ? log.step(t) != 0.f
+                            : std::clamp(int(std::lround(log.at(t))), 0, 1023);
+        // digital levels are recorded by the net
+        if (value != last && !digital)
+            record_pin(pin, true, value);
+        last = value;
+        return value;
+    }
+
+    int digital_read(uint8_t) { return digital ? read() : read() >= 512; }
+    int analog_read(uint8_t) { return read(); }
+    // the log only depends on time
+    void state(StateBuffer &s) { s(last); }
+};
+
+// An HC-SR04 ultrasonic sensor. A pulse on TRIG starts a measurement, after
+// which ECHO stays HIGH for as long as sound takes to get to the obstacle and
+// back, 58 µs per cm. The distance is set with the mouse wheel, or comes from
+// a log (in cm). pulseIn() on ECHO gets the echo's width straight from the
+// distance, instead of reading the pin over and over (see pulse_in()).
+struct Sonar {
+    static constexpr float US_PER_CM = 58.f;
+    static constexpr float MIN_CM = 2.f, MAX_CM = 400.f;
+    static constexpr uint64_t ECHO_DELAY = 250;    // from TRIG going LOW
+    static constexpr uint64_t NO_ECHO = 38000;     // nothing in range
+
+    Point pos;
+    uint8_t trig, echo;
+    float distance;
+    SensorLog log;
+    bool trig_high = false;
+    bool level = false;     // of ECHO, last time it was read
+    uint64_t echo_start = 0, echo_end = 0;  // in micros()
+
+    Sonar(Point pos, uint8_t trig, uint8_t echo, float distance, const char *log_pathname)
+        : pos{pos}, trig{trig}, echo{echo}, distance{distance}
+    {
+        if (log_pathname)
+            log = SensorLog(log_pathname);
+    }
+
+    void digital_write(uint8_t pin, uint8_t value)
+    {
+        if (pin != trig)
+            return;
+        if (trig_high && value == LOW) {
+            if (log.count > 0)
+                distance = log.at(millis());
+            echo_start = micros() + ECHO_DELAY;
+            echo_end = echo_start + (distance < MIN_CM || distance > MAX_CM ? NO_ECHO
+                                                                             : uint64_t(distance * US_PER_CM));
+        }
+        trig_high = value != LOW;
+    }
+
+    int digital_read(uint8_t pin)
+    {
+        if (pin == trig)
+            return -1;
+        auto now = micros();
+        level = now >= echo_start && now < echo_end;
+        return level;
+    }
+
+    // What pulseIn() would measure, and how long it would take to: the
+    // echo's width if it starts and ends within timeout, otherwise 0 after
+    // the whole timeout. ECHO never has LOW pulses, as it's LOW before and
+    // after an echo.
+    unsigned long pulse_in(uint8_t pin, uint8_t state, unsigned long timeout, uint64_t &wait)
+    {
+        auto now = micros();
+        wait = timeout;
+        if (pin != echo || state != HIGH || now >= echo_start || echo_end - now > timeout)
+            return 0;
+        wait = echo_end - now;
+        return echo_end - echo_start;
+    }
+
+    void state(StateBuffer &s) { s(distance, trig_high, level, echo_start, echo_end); }
+
+    void mouse_wheel(Point mouse_pos, bool up_or_down)
+    {
+        if (log.count == 0 && collision_rect_point({ .pos = pos, .size = {64,32} }, mouse_pos))
+            distance = std::clamp(distance + (up_or_down ? 5.f : -5.f), 0.f, MAX_CM + 50.f);
+    }
+};
+
+struct LCD {
+    Point pos, size;
+    uint8_t sda, scl;
+    std::vector<uint8_t> char_vec;
+    uint8_t addr = 0;
+    uint8_t buf[2] = {0, 0};
+    uint8_t idx = 0;
+    bool backlight = false;
+
+    // Custom characters (CGRAM). Characters 0-7 (and 8-15, which mirror
+    // them) are drawn from a small texture of their own, where only the
+    // characters redefined since the last frame get drawn again.
+    uint8_t cgram[8][8] = {};
+    uint8_t cgram_addr = 0;
+    uint8_t dirty_glyphs = 0xff;
+    int glyph_gfx = -1;     // the frontend's
+
+    LCD(Point pos, Point size, uint8_t addr, uint8_t sda, uint8_t scl)
+        : pos{pos}, size{size}, sda{sda}, scl{scl}
+    {
+        char_vec = std::vector(size.x * size.y, uint8_t('1'));
+    }
+
+    void receive(uint8_t val)
+    {
+        // Receive 2 bytes (cmd, data), then handle them
+        // See comment for LiquidCrystal_I2C stuff below for details.
+        buf[idx++] = val;
+        if (idx == 2) {
+            idx = 0;
+            command(buf[0], buf[1]);
+        }
+    }
+
+    void state(StateBuffer &s)
+    {
+        s(char_vec, addr, buf, idx, backlight, cgram, cgram_addr);
+        if (s.loading)
+            dirty_glyphs = 0xff;
+    }
+
+    void command(uint8_t cmd, uint8_t data)
+    {
+        switch (cmd) {
+        case 0: char_vec[addr++] = data;                          break;
+        case 1: backlight = bool(data);                           break;
+        case 2: std::fill(char_vec.begin(), char_vec.end(), ' '); break;
+        case 3: addr = data;                                      break;
+        case 4: cgram_addr = (data & 7) * 8;                      break;
+        case 5:
+            cgram[cgram_addr / 8][cgram_addr % 8] = data & 0x1f;
+            dirty_glyphs |= 1 << (cgram_addr / 8);
+            cgram_addr = (cgram_addr + 1) % 64;
+            break;
+        default: fprintf(stderr, "LCD: unknown command\n");      break;
+        }
+    }
+};
+
+/*
+ * An SSD1306 graphic OLED, 128 pixels wide and 64 (or 32) high, like the
+ * ones driven by Adafruit_SSD1306 or U8g2. Its RAM is 8 pages of 128 bytes,
+ * each byte a column of 8 pixels, LSB on top; the sketch sends commands to
+ * pick a range of columns and pages, then data that fills them in.
+ * On I2C, each transmission starts with a control byte saying whether
+ * commands or data follow. On SPI, the DC pin says it instead (HIGH for
+ * data), while CS is LOW. Only the pages written since the last frame are
+ * drawn again (see dirty_pages).
+ */
+struct OLED {
+    static constexpr int WIDTH = 128, PAGES = 8;
+
+    Point pos;
+    int height;
+    uint8_t cs = 0xff, dc = 0xff;   // on SPI
+    bool selected = false, data_mode = false;
+    uint8_t ram[PAGES][WIDTH] = {};
+    uint8_t dirty_pages = 0xff;
+    int gfx = -1;           // the frontend's
+
+    // where writes go, and how they move on (0 horizontal, 1 vertical, 2 page)
+    uint8_t mode = 2;
+    uint8_t col = 0, col_start = 0, col_end = WIDTH - 1;
+    uint8_t page = 0, page_start = 0, page_end = PAGES - 1;
+
+    bool display_on = false, inverted = false, all_on = false;
+    // Most modules have the panel upside down, so that the usual 0xA1 and
+    // 0xC8 show it the right way up.
+    bool seg_remap = false, com_reverse = false;
+    uint8_t start_line = 0;
+
+    // the command being received, and how many argument bytes it still needs
+    uint8_t cmd = 0, cmd_args[6], cmd_len = 0, cmd_needs = 0;
+    // on I2C: whether the next byte is a control byte, or just one data or
+    // command byte until the next control byte (Co bit)
+    bool expect_control = true, single = false;
+
+    OLED(Point pos, int height) : pos{pos}, height{height == 32 ? 32 : 64} {}
+
+    void i2c_receive(uint8_t b)
+    {
+        if (expect_control) {
+            data_mode = b & 0x40;
+            single = b & 0x80;
+            expect_control = false;
+            return;
+        }
+        receive(b);
+        expect_control = single;
+    }
+
+    void i2c_end() { expect_control = true; cmd_needs = 0; }
+
+    // CS has a pull-up, see SPIChipSelect
+    int pull(uint8_t pin) { return pin == cs ? HIGH : -1; }
+
+    void digital_write(uint8_t pin, uint8_t value)
+    {
+        if (pin == cs)
+            selected = value == LOW;
+        else if (pin == dc)
+            data_mode = value != LOW;
+    }
+
+    // never answers: the SSD1306 has no MISO
+    bool spi_transfer(std::span<uint8_t> data)
+    {
+        if (selected)
+            for (auto b : data)
+                receive(b);
+        return false;
+    }
+
+    void receive(uint8_t b)
+    {
+        if (data_mode)
+            write(b);
+        else if (cmd_needs > 0) {
+            cmd_args[cmd_len++] = b;
+            if (--cmd_needs == 0)
+                command(cmd, cmd_args);
+        } else {
+            cmd = b;
+            cmd_len = 0;
+            cmd_needs = args_of(b);
+            if (cmd_needs == 0)
+                command(cmd, cmd_args);
+        }
+    }
+
+    static uint8_t args_of(uint8_t cmd)
+    {
+        switch (cmd) {
+        case 0x21: case 0x22: case 0xA3: return 2;
+        case 0x26: case 0x27:            return 6;
+        case 0x29: case 0x2A:            return 5;
+        case 0x20: case 0x81: case 0x8D: case 0xA8: case 0xD3:
+        case 0xD5: case 0xD9: case 0xDA: case 0xDB: return 1;
+        default:                         return 0;
+        }
+    }
+
+    void command(uint8_t cmd, const uint8_t *args)
+    {
+        if (cmd < 0x10)
+            col = (col & 0xf0) | cmd;
+        else if (cmd < 0x20)
+            col = (col & 0x0f) | (cmd & 0x0f) << 4;
+        else if (cmd >= 0x40 && cmd < 0x80)
+            start_line = cmd & 0x3f;
+        else if (cmd >= 0xB0 && cmd < 0xB8)
+            page = cmd & 7;
+        else
+            switch (cmd) {
+            case 0x20: mode = std::min(args[0] & 3, 2); break;
+            case 0x21: col  = col_start  = args[0] & 0x7f; col_end  = args[1] & 0x7f; break;
+            case 0x22: page = page_start = args[0] & 7;    page_end = args[1] & 7;    break;
+            case 0xA0: case 0xA1: seg_remap   = cmd & 1; dirty_pages = 0xff; break;
+            case 0xC0: case 0xC8: com_reverse = cmd & 8; dirty_pages = 0xff; break;
+            case 0xA4: case 0xA5: all_on      = cmd & 1; break;
+            case 0xA6: case 0xA7: inverted    = cmd & 1; dirty_pages = 0xff; break;
+            case 0xAE: case 0xAF: display_on  = cmd & 1; break;
+            // contrast, scrolling, timing and charge pump don't show
+            default: break;
+            }
+    }
+
+    void write(uint8_t b)
+    {
+        ram[page][col] = b;
+        dirty_pages |= 1 << page;
+        switch (mode) {
+        case 0:
+            if (col++ == col_end) {
+                col = col_start;
+                page = page == page_end ? page_start : page + 1;
+            }
+            break;
+        case 1:
+            if (page++ == page_end) {
+                page = page_start;
+                col = col == col_end ? col_start : col + 1;
+            }
+            break;
+        default:
+            col = (col + 1) & 0x7f;
+            break;
+        }
+    }
+
+    // Where RAM row y and column x show up, before scrolling by the start
+    // line: the panel shows the rows from scroll() on, wrapping around.
+    int row_of(int y) const    { return com_reverse ? y : (height - 1 - y) & 63; }
+    int column_of(int x) const { return seg_remap ? x : WIDTH - 1 - x; }
+    int scroll() const         { return com_reverse ? start_line : (64 - start_line) & 63; }
+
+    // what the panel shows at (x, y), from its top left
+    bool pixel(int x, int y) const
+    {
+        if (!display_on)
+            return false;
+        if (all_on)
+            return true;
+        int t = (y + scroll()) & 63;
+        int ram_y = com_reverse ? t : (height - 1 - t) & 63;
+        return bool(ram[ram_y / 8][column_of(x)] >> (ram_y % 8) & 1) != inverted;
+    }
+
+    void state(StateBuffer &s)
+    {
+        s(selected, data_mode, ram, mode, col, col_start, col_end, page, page_start, page_end,
+          display_on, inverted, all_on, seg_remap, com_reverse, start_line,
+          cmd, cmd_args, cmd_len, cmd_needs, expect_control, single);
+        if (s.loading)
+            dirty_pages = 0xff;
+    }
+};
+
+// Occupies the chip select pin of an SPI device. The device is selected
+// while the pin is LOW, and pulls it up, like most modules do, so that it
+// isn't selected before the sketch drives the pin.
+struct SPIChipSelect {
+    SPIDevice *device;
+    bool selected = false;
+
+    explicit SPIChipSelect(SPIDevice *device) : device{device} {}
+
+    void digital_write(uint8_t, uint8_t value)
+    {
+        if (selected != (value == LOW)) {
+            selected = value == LOW;
+            device->select(selected);
+        }
+    }
+    int pull(uint8_t) { return HIGH; }
+    bool spi_transfer(std::span<uint8_t> data)
+    {
+        if (selected)
+            device->transfer(data);
+        return selected;
+    }
+    // the device's own state isn't ours to save
+    void state(StateBuffer &s) { s(selected); }
+};
+
+// Plots the numbers the sketch prints on Serial, like the Arduino IDE's
+// plotter: one line per sample, values separated by spaces, commas or tabs,
+// each optionally labeled ("temp:21.5"). Each channel only keeps the min and
+// max of every pixel column, so that taking in a sample is cheap, and
+// drawing never depends on how many samples came in.
+struct Plotter {
+    static constexpr int MAX_CHANNELS = 8;
+
+    struct Column {
+        float min = INFINITY, max = -INFINITY;
+    };
+
+    Rect rect;
+    int samples_per_column;
+    char line[128];
+    int len = 0;
+    int channels = 0;
+    // one ring of columns per channel, all as wide as the plot
+    std::vector<Column> columns[MAX_CHANNELS];
+    uint64_t column = 0;    // the one being filled, counting from the first
+    int samples = 0;        // in that column
+
+    Plotter(Rect rect, int samples_per_column)
+        : rect{rect}, samples_per_column{std::max(samples_per_column, 1)}
+    {
+        for (auto &c : columns)
+            c.resize(std::max(int(rect.size.x), 1));
+    }
+
+    void serial_write(uint8_t c)
+    {
+        if (c == '\n') {
+            line[len] = '\0';
+            add_line();
+            len = 0;
+        } else if (c != '\r' && len < int(sizeof(line)) - 1)
+            line[len++] = c;
+    }
+
+    // Every token is a channel, even one that isn't a number (which then
+    // has no sample in this line), so that the channels after it stay put.
+    // Separators in a row don't make empty ones.
+    void add_line()
+    {
+        int ch = 0, used = 0;
+        for (char *p = line, *end = line + len; p < end && ch < MAX_CHANNELS; ) {
+            auto *token_end = std::find_if(p, end, [](char c) { return c == ' ' || c == ',' || c == '\t'; });
+            if (token_end == p) {
+                p++;
+                continue;
+            }
+            auto *colon = std::find(p, token_end, ':');
+            auto *num = colon == token_end ? p : colon + 1;
+            float value;
+            if (num < token_end && std::from_chars(num, token_end, value).ec == std::errc{}) {
+                auto &col = columns[ch][column % columns[0].size()];
+                col.min = std::min(col.min, value);
+                col.max = std::max(col.max, value);
+                used = ch + 1;
+            }
+            ch++;
+            p = token_end + 1;
+        }
+        if (used == 0)
+            return;
+        channels = std::max(channels, used);
+        if (++samples == samples_per_column) {
+            samples = 0;
+            column++;
+            for (auto &c : columns)
+                c[column % c.size()] = Column{};
+        }
+    }
+};
+
+/*
+ * The board's components are kept in one array per type, and pins refer to
+ * them by type and index. Calls on components are resolved at compile time
+ * per type, so there are no virtual calls, and loops over all components
+ * only touch the types that do something.
+ */
+
+struct ComponentRef {
+    static constexpr uint8_t NONE = 0xff;
+    uint8_t type = NONE;
+    uint16_t index = 0;
+};
+
+template <typename... Ts>
+struct ComponentPools {
+    std::tuple<std::vector<Ts>...> pools;
+
+    template <typename T>
+    std::vector<T> & get() { return std::get<std::vector<T>>(pools); }
+
+    template <typename T, std::size_t I = 0>
+    static constexpr uint8_t type_of()
+    {
+        if constexpr (std::is_same_v<T, std::tuple_element_t<I, std::tuple<Ts...>>>)
+            return I;
+        else
+            return type_of<T, I+1>();
+    }
+
+    template <typename T>
+    ComponentRef add(auto&&... args)
+    {
+        auto &pool = get<T>();
+        pool.emplace_back(FWD(args)...);
+        return { .type = type_of<T>(), .index = uint16_t(pool.size() - 1) };
+    }
+
+    // Calls fn with each pool, i.e. fn(std::vector<T> &) for every type T.
+    void for_each(auto &&fn)
+    {
+        std::apply([&](auto &...pool) { (fn(pool), ...); }, pools);
+    }
+
+    // Calls fn with the component ref points to, if there is one.
+    void visit(ComponentRef ref, auto &&fn)
+    {
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            ((ref.type == I ? (fn(std::get<I>(pools)[ref.index]), true) : false) || ...);
+        }(std::index_sequence_for<Ts...>{});
+    }
+};
+
+/*
+ * What's connected to a pin. Its level comes from the MCU when the pin is an
+ * OUTPUT, otherwise from components driving it (drive(), like a pressed
+ * button, or digital_read() for those whose level changes by itself over
+ * time, like sensors), otherwise from pull resistors (pull(), which gives -1
+ * for a pin it doesn't pull, or the pin's own with INPUT_PULLUP, which is
+ * weaker than any on the board). A pin with nothing at all reads LOW, where a
+ * real one could read anything.
+ * The level is only worked out again when something on the net changed
+ * (see dirty), except for digital_read(), which is asked on every read.
+ * Components taking the level (digital_write(), like LEDs) get it whenever
+ * it changes.
+ */
+struct Net {
+    std::vector<ComponentRef> components;
+    uint8_t mode = INPUT;   // INPUT or OUTPUT
+    uint8_t out = LOW;      // the last digitalWrite(): on INPUT, HIGH turns the pull-up on, like on AVR
+    bool dirty = true;
+    bool live = false;      // has components with digital_read()
+    // as of the last time it was dirty, -1 for none
+    int8_t driven = -1, pulled = -1;
+    uint8_t level = 0xff;   // none yet, so that components get the first one
+    bool warned = false;    // about a short circuit
+};
+
+/*
+ * Boards running together talk through these. Everything sent is stamped
+ * with the (virtual) time it arrives at, and the receiver only sees it once
+ * its own clock gets there.
+ */
+
+struct SerialByte {
+    uint64_t time;
+    uint8_t data;
+};
+
+struct I2CMessage {
+    static constexpr int MAX_SIZE = 32; // same as the Wire library's buffer
+    uint64_t time;
+    uint8_t size;
+    uint8_t data[MAX_SIZE];
+};
+
+struct ArduinoBoard {
+    static constexpr std::size_t SERIAL_BUFFER_SIZE = 64;
+
+    // The sketch running on the board: normally the one linked with the
+    // library, if any.
+    Sketch sketch = { .setup = ::setup, .loop = ::loop, .main = nullptr, .globals = {} };
+    int id = 0;
+
+    ComponentPools<LED, Button, PullResistor, Potentiometer, Sensor, Sonar, LCD, OLED, SPIChipSelect, Plotter> components;
+    std::array<Net, 20> nets;
+    std::unordered_map<uint8_t, std::function<void(uint8_t)>> i2c_bus;
+    // for devices that need to know when a transmission ends
+    std::unordered_map<uint8_t, std::function<void()>> i2c_end;
+
+    // virtual time in microseconds, only used when running several boards
+    uint64_t now = 0;
+    // what the cost model charged so far, see charge()
+    uint64_t cycles = 0;
+    // added to the OS clock, so that restoring a snapshot can move it back,
+    // and pulseIn() forward
+    int64_t clock_offset = 0;
+    // random(), same algorithm and default seed as avr-libc
+    uint32_t random_state = 1;
+    // the pins shared with other processes, see arduino_sdl::share_pins()
+    GpioShm gpio;
+
+    // Serial: TX goes into the peer's serial_rx, received bytes wait in
+    // serial_in (which drops bytes when full, like the real one).
+    unsigned long serial_baud = 9600;
+    uint64_t serial_busy_until = 0;
+    ArduinoBoard *serial_peer = nullptr;
+    bool serial_line_start = true;
+    Ring<SerialByte, 1024> serial_rx;
+    std::deque<uint8_t> serial_in;
+
+    // I2C with other boards: messages to an address that isn't on this
+    // board are sent to the peers that joined the bus with that address.
+    std::vector<ArduinoBoard *> i2c_peers;
+    int wire_addr = -1;
+    void (*on_receive)(int) = nullptr;
+    std::vector<uint8_t> wire_out;
+    std::deque<uint8_t> wire_in;
+    Ring<I2CMessage, 64> i2c_rx;
+
+    void add_i2c(uint8_t addr, auto &&fn)
+    {
+        i2c_bus[addr] = fn;
+    }
+
+    void attach(uint8_t pin, ComponentRef ref)
+    {
+        auto &net = nets[pin];
+        net.components.push_back(ref);
+        net.dirty = true;
+        components.visit(ref, [&](auto &c) {
+            if constexpr (requires { c.digital_read(pin); })
+                net.live = true;
+        });
+    }
+
+    // Calls fn with every component on the pin.
+    void visit_pin(uint8_t pin, auto &&fn)
+    {
+        if (pin < nets.size())
+            for (auto ref : nets[pin].components)
+                components.visit(ref, fn);
+    }
+
+    // The pin's level, see Net. With notify, the components taking it get
+    // it even if it didn't change.
+    uint8_t level(uint8_t pin, bool notify = false);
+    // Works out again the nets that need it, so that whatever takes their
+    // level keeps up, even if the sketch never reads them.
+    void update_nets()
+    {
+        for (uint8_t pin = 0; pin < nets.size(); pin++)
+            if (nets[pin].dirty || nets[pin].live)
+                level(pin);
+    }
+
+    // Everything that changes while the sketch runs, its globals included
+    // (but not what they point to). The clock is saved apart, see
+    // save_state().
+    void state(StateBuffer &s)
+    {
+        components.for_each([&]<typename T>(std::vector<T> &pool) {
+            if constexpr (requires (T c) { c.state(s); })
+                for (auto &c : pool)
+                    s(c);
+        });
+        for (auto &net : nets) {
+            s(net.mode, net.out, net.level);
+            if (s.loading)
+                net.dirty = true;
+        }
+        s(cycles, serial_baud, serial_busy_until, serial_line_start, serial_rx, serial_in,
+          wire_addr, wire_out, wire_in, i2c_rx, random_state);
+        for (auto mem : sketch.globals)
+            s.globals(mem);
+    }
+
+    // Takes in whatever other boards sent up to now. Must be called with
+    // this board as the current one, as it may call the sketch's
+    // Wire.onReceive() handler.
+    void receive()
+    {
+        for (SerialByte b; serial_rx.peek(b) && b.time <= now; ) {
+            serial_rx.pop(b);
+            if (serial_in.size() < SERIAL_BUFFER_SIZE)
+                serial_in.push_back(b.data);
+        }
+        for (I2CMessage m; i2c_rx.peek(m) && m.time <= now; ) {
+            i2c_rx.pop(m);
+            wire_in.assign(m.data, m.data + m.size);
+            if (on_receive)
+                on_receive(m.size);
+        }
+    }
+};
+
+// Every sketch runs on its own board (see arduino_sdl::add_board()), and the
+// Arduino functions act on the current one. A deque, so that boards never move.
+extern std::deque<ArduinoBoard> boards;
+extern ArduinoBoard *board;
+
+// With several boards (or when fuzzing), time is simulated instead of
+// taken from the OS clock. Every loop() then takes at least LOOP_TIME
+// microseconds, so that loops without any delay() still move the clock.
+extern bool virtual_time;
+constexpr uint64_t LOOP_TIME = 10;
+
+extern bool running;
+extern bool headless;   // no frontend at all, e.g. when fuzzing
+
+// goes back us microseconds after the current loop(), when keeping snapshots
+bool request_rewind(uint64_t us);
+
+// For fuzzing: the EEPROM (see eeprom.cpp) becomes a copy of its file, made
+// when the sketch first uses it, and eeprom_reset() drops that copy, write
+// counts included, so that the next use starts from the file again.
+void eeprom_copy_on_write();
+void eeprom_reset();
+
+/*
+ * What the core needs from a frontend. Each frontend defines these (and the
+ * frontend functions in arduino_sdl.h, like start()), and the one to use is
+ * picked when linking.
+ */
+namespace frontend {
+
+void poll();    // takes in input
+void draw();    // shows a frame
+// frequency 0 stops the tone on pin, if it's playing there
+void tone(uint8_t pin, unsigned frequency, unsigned long duration);
+void quit();
+
+} // namespace frontend
@@ -0,0 +1,45 @@
+#include "cost_model.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+CostModel cost_model;
+
+void CostModel::start()
+{
+    if (enabled)
+        return;
+    enabled = true;
+    std::atexit([] { cost_model.report(); });
+}
+
+bool CostModel::set(const char *name, uint64_t cycles)
+{
+    for (auto &e : table) {
+        if (std::strcmp(e.name, name) == 0) {
+            e.cycles = cycles;
+            return true;
+        }
+    }
+    fprintf(stderr, "warning: no cost for %s\n", name);
+    return false;
+}
+
+void CostModel::report()
+{
+    uint64_t sum = 0;
+    for (auto &e : table)
+        sum += e.total;
+    if (sum == 0)
+        return;
+    auto sorted = table;
+    std::sort(sorted.begin(), sorted.end(), [](const Entry &a, const Entry &b) { return a.total > b.total; });
+    fprintf(stderr, "cost model: %.3f ms spent in Arduino calls\n", double(sum) / CYCLES_PER_US / 1000.0);
+    fprintf(stderr, "  %-14s %12s %12s %6s\n", "function", "calls", "ms", "%");
+    for (auto &e : sorted)
+        if (e.calls > 0)
+            fprintf(stderr, "  %-14s %12llu %12.3f %5.1f%%\n", e.name, (unsigned long long) e.calls,
+                    double(e.total) / CYCLES_PER_US / 1000.0, 100.0 * e.total / sum);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/*
+ * What Arduino calls would cost on a 16MHz AVR. When enabled, every call is
+ * charged its cycles, which move millis() and micros() forward, so that a
+ * sketch runs here about as slowly as it would on the board. Totals per
+ * function are printed at exit, to show where the time goes.
+ * The defaults are rough measurements, and can be changed with
+ * arduino_sdl::set_cost().
+ */
+struct CostModel {
+    enum Function {
+        PIN_MODE,
+        DIGITAL_READ,
+        DIGITAL_WRITE,
+        ANALOG_READ,
+        ANALOG_WRITE,
+        WIRE_BYTE,
+        SERIAL_BYTE,
+        SPI_BYTE,
+        NUM_FUNCTIONS,
+    };
+
+    struct Entry {
+        const char *name;
+        uint64_t cycles;
+        uint64_t calls = 0;
+        uint64_t total = 0;  // cycles, waiting included
+    };
+
+    static constexpr uint64_t CYCLES_PER_US = 16;
+
+    bool enabled = false;
+    std::array<Entry, NUM_FUNCTIONS> table = {{
+        { "pinMode",        60 },
+        { "digitalRead",    58 },
+        { "digitalWrite",   64 },
+        { "analogRead",   1790 },   // 13 ADC clocks at 125kHz, plus setup
+        { "analogWrite",    80 },
+        { "Wire byte",    1440 },   // 9 bits at 100kHz
+        { "Serial byte",    80 },   // into the TX buffer, see charge_wait()
+        { "SPI byte",       48 },   // 8 bits at 4MHz, plus the loop around it
+    }};
+
+    void start();
+    bool set(const char *name, uint64_t cycles);
+
+    // both return the cycles charged
+    uint64_t charge(Function f, uint64_t n = 1)
+    {
+        table[f].calls += n;
+        table[f].total += table[f].cycles * n;
+        return table[f].cycles * n;
+    }
+
+    // time spent blocked in a call, e.g. waiting for room in a buffer
+    uint64_t charge_wait(Function f, uint64_t us)
+    {
+        table[f].total += us * CYCLES_PER_US;
+        return us * CYCLES_PER_US;
+    }
+
+    void report();
+};
+
+extern CostModel cost_model;
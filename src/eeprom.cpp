@@ -0,0 +1,241 @@
+#include "EEPROM.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "core.h"
+#include "arduino_sdl.h"
+
+EEPROMClass EEPROM;
+
+namespace {
+
+// Set before the first access (see arduino_sdl::eeprom_file() and
+// eeprom_copy_on_write()).
+std::string base_pathname = "eeprom.bin";
+bool copy_on_write = false;     // writes stay in memory, see Eeprom::map_copy()
+
+/*
+ * Each board has its own, see current(). The file holds SIZE bytes of data,
+ * followed by a uint32_t write counter for each byte. It is created on
+ * first use, erased (all 0xFF) like a new chip would be.
+ */
+struct Eeprom {
+    static constexpr int SIZE = 1024;               // same as an ATmega328P
+    static constexpr uint32_t ENDURANCE = 100'000;  // write cycles per cell
+    static constexpr size_t FILE_SIZE = SIZE + SIZE * sizeof(uint32_t);
+
+    std::string pathname;
+    uint8_t *data = nullptr;
+    uint32_t *writes = nullptr;
+    bool failed = false;
+
+    // only for this run
+    std::vector<uint32_t> session_writes;
+    std::vector<bool> warned;
+    unsigned long start_time = 0;
+
+    bool open()
+    {
+        if (data || failed)
+            return data != nullptr;
+        failed = true;
+        void *p = copy_on_write ? map_copy() : map_file();
+        if (!p)
+            return false;
+        failed = false;
+        data   = (uint8_t *) p;
+        writes = (uint32_t *) (data + SIZE);
+        session_writes = std::vector<uint32_t>(SIZE, 0);
+        warned = std::vector<bool>(SIZE, false);
+        start_time = millis();
+        static bool reporting = false;
+        if (!reporting)
+            std::atexit(report_at_exit);
+        reporting = true;
+        return true;
+    }
+
+    // The file itself, created erased if need be.
+    void *map_file()
+    {
+        int fd = ::open(pathname.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "warning: couldn't open %s, EEPROM won't work\n", pathname.c_str());
+            return nullptr;
+        }
+        bool created = lseek(fd, 0, SEEK_END) == 0;
+        if (ftruncate(fd, FILE_SIZE) < 0) {
+            fprintf(stderr, "warning: couldn't resize %s, EEPROM won't work\n", pathname.c_str());
+            close(fd);
+            return nullptr;
+        }
+        void *p = mmap(nullptr, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "warning: couldn't map %s, EEPROM won't work\n", pathname.c_str());
+            return nullptr;
+        }
+        if (created)
+            std::memset(p, 0xff, SIZE);
+        return p;
+    }
+
+    // A copy of the file, which is left alone (and not even created), or of
+    // an erased EEPROM if there's no file yet.
+    void *map_copy()
+    {
+        void *p = mmap(nullptr, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "warning: couldn't allocate the EEPROM, it won't work\n");
+            return nullptr;
+        }
+        std::memset(p, 0xff, SIZE);
+        int fd = ::open(pathname.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            if (::read(fd, p, FILE_SIZE) < 0)
+                fprintf(stderr, "warning: couldn't read %s, EEPROM starts out erased\n", pathname.c_str());
+            close(fd);
+        }
+        return p;
+    }
+
+    // Forgets everything since open(), which happens again on next use.
+    void reset()
+    {
+        if (data)
+            munmap(data, FILE_SIZE);
+        data = nullptr;
+        writes = nullptr;
+        failed = false;
+    }
+
+    uint8_t read(int index)
+    {
+        return open() && index >= 0 && index < SIZE ? data[index] : 0xff;
+    }
+
+    void write(int index, uint8_t value)
+    {
+        if (!open() || index < 0 || index >= SIZE)
+            return;
+        data[index] = value;
+        writes[index]++;
+        session_writes[index]++;
+        if (writes[index] == ENDURANCE)
+            fprintf(stderr, "warning: EEPROM cell %d has now been written %u times, "
+                            "a real EEPROM is only rated for %u\n", index, ENDURANCE, ENDURANCE);
+        else if (session_writes[index] % 1000 == 0 && !warned[index])
+            check_rate(index);
+    }
+
+    // Warns if a cell is written often enough to wear out in less than
+    // a year, e.g. because it gets written on every loop().
+    void check_rate(int index)
+    {
+        double secs = (millis() - start_time) / 1000.0;
+        double rate = session_writes[index] / std::max(secs, 0.001);
+        double left = writes[index] >= ENDURANCE ? 0 : (ENDURANCE - writes[index]) / rate;
+        if (left > 365 * 24 * 3600.0)
+            return;
+        warned[index] = true;
+        fprintf(stderr, "warning: EEPROM cell %d written %u times in %.1fs; "
+                        "at this rate a real EEPROM wears out in %.1f hours\n",
+                index, session_writes[index], secs, left / 3600.0);
+    }
+
+    static void report_at_exit();
+    void report()
+    {
+        auto it = std::max_element(session_writes.begin(), session_writes.end());
+        if (it == session_writes.end() || *it == 0)
+            return;
+        int index = it - session_writes.begin();
+        fprintf(stderr, "EEPROM %s: most written cell is %d (%u writes this run, %u total, %.1f%% of its endurance)\n",
+                pathname.c_str(), index, *it, writes[index], 100.0 * writes[index] / ENDURANCE);
+    }
+};
+
+// A deque, so that they never move. Board n's file is the same as the first
+// one's, with .n before the extension, e.g. eeprom.1.bin.
+std::deque<Eeprom> eeproms;
+
+Eeprom &current()
+{
+    while (int(eeproms.size()) <= board->id) {
+        auto &e = eeproms.emplace_back();
+        int id = eeproms.size() - 1;
+        e.pathname = base_pathname;
+        if (id > 0) {
+            auto dot = e.pathname.rfind('.'), slash = e.pathname.rfind('/');
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+                dot = e.pathname.size();
+            e.pathname.insert(dot, "." + std::to_string(id));
+        }
+    }
+    return eeproms[board->id];
+}
+
+void Eeprom::report_at_exit()
+{
+    for (auto &e : eeproms)
+        e.report();
+}
+
+} // namespace
+
+uint8_t EERef::operator*() const
+{
+    return current().read(index);
+}
+
+EERef & EERef::operator=(uint8_t value)
+{
+    current().write(index, value);
+    return *this;
+}
+
+EERef & EERef::update(uint8_t value)
+{
+    // like on a real chip, only cells that actually change are worn
+    auto &eeprom = current();
+    if (eeprom.read(index) != value)
+        eeprom.write(index, value);
+    return *this;
+}
+
+uint16_t EEPROMClass::length()
+{
+    return Eeprom::SIZE;
+}
+
+void eeprom_copy_on_write()
+{
+    for (auto &e : eeproms)
+        if (e.data && !copy_on_write)
+            fprintf(stderr, "warning: EEPROM already in use, %s gets written\n", e.pathname.c_str());
+    copy_on_write = true;
+}
+
+void eeprom_reset()
+{
+    if (copy_on_write)
+        for (auto &e : eeproms)
+            e.reset();
+}
+
+namespace arduino_sdl {
+
+void eeprom_file(const char *pathname)
+{
+    base_pathname = pathname;
+}
+
+} // namespace arduino_sdl
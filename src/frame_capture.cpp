@@ -0,0 +1,190 @@
+#include "frame_capture.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+FrameCapture frame_capture;
+
+namespace {
+
+void put_u32(std::vector<uint8_t> &v, uint32_t n)
+{
+    v.push_back(n >> 24);
+    v.push_back(n >> 16);
+    v.push_back(n >>  8);
+    v.push_back(n);
+}
+
+void write_chunk(FILE *f, const char *type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk;
+    put_u32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put_u32(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+    fwrite(chunk.data(), 1, chunk.size(), f);
+}
+
+// 0xAARRGGBB to bytes in R, G, B, A order
+void to_rgba(uint8_t *out, const uint32_t *pixels, int n)
+{
+    for (int i = 0; i < n; i++) {
+        out[i*4 + 0] = pixels[i] >> 16;
+        out[i*4 + 1] = pixels[i] >>  8;
+        out[i*4 + 2] = pixels[i];
+        out[i*4 + 3] = pixels[i] >> 24;
+    }
+}
+
+// Whether pattern has exactly one %d (with flags and a width, like %05d)
+// and otherwise only %%, as it's then given to snprintf() as the format.
+bool valid_pattern(const char *pattern)
+{
+    int conversions = 0;
+    for (const char *p = pattern; *p; p++) {
+        if (*p != '%')
+            continue;
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+        p++;
+        while (*p && strchr("-+ 0#", *p))
+            p++;
+        while (isdigit((unsigned char) *p))
+            p++;
+        if (*p != 'd' && *p != 'i')
+            return false;
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+} // namespace
+
+void FrameCapture::start(const char *pathname, int width, int height)
+{
+    if (enabled)
+        return;
+    this->pathname = pathname;
+    auto len = this->pathname.size();
+    png = len > 4 && this->pathname.compare(len - 4, 4, ".png") == 0;
+    if (png && !valid_pattern(pathname)) {
+        fprintf(stderr, "warning: %s needs one %%d for the frame number, frame capture disabled\n", pathname);
+        return;
+    }
+    if (!png) {
+        is_pipe = pathname[0] == '|';
+        out = is_pipe ? popen(pathname + 1, "w") : fopen(pathname, "wb");
+        if (!out) {
+            fprintf(stderr, "warning: couldn't open %s, frame capture disabled\n", pathname);
+            return;
+        }
+    }
+    for (int i = 0; i < POOL_SIZE; i++) {
+        pool[i].pixels.resize(width * height);
+        free_buffers.push(i);
+    }
+    stop_encoder = false;
+    encoder = std::thread([this] { encoder_loop(); });
+    enabled = true;
+    std::atexit([] { frame_capture.stop(); });
+}
+
+void FrameCapture::stop()
+{
+    if (!enabled)
+        return;
+    enabled = false;
+    stop_encoder = true;
+    encoder.join();
+    if (out) {
+        if (is_pipe)
+            pclose(out);
+        else
+            fclose(out);
+        out = nullptr;
+    }
+    fprintf(stderr, "frame capture: %lu frames written, %lu dropped\n", written, dropped);
+}
+
+uint32_t *FrameCapture::acquire(int width, int height)
+{
+    if (!free_buffers.pop(current)) {
+        dropped++;
+        return nullptr;
+    }
+    auto &buf = pool[current];
+    buf.width  = width;
+    buf.height = height;
+    buf.pixels.resize(width * height);
+    return buf.pixels.data();
+}
+
+void FrameCapture::submit()
+{
+    full_buffers.push(current);
+    current = -1;
+}
+
+void FrameCapture::encoder_loop()
+{
+    for (;;) {
+        bool done = stop_encoder.load();
+        for (int i; full_buffers.pop(i); ) {
+            if (png)
+                write_png(pool[i]);
+            else
+                write_raw(pool[i]);
+            written++;
+            free_buffers.push(i);
+        }
+        if (done)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+void FrameCapture::write_png(const Buffer &buf)
+{
+    char name[4096];
+    snprintf(name, sizeof(name), pathname.c_str(), int(written));
+    FILE *f = fopen(name, "wb");
+    if (!f) {
+        fprintf(stderr, "warning: couldn't write %s\n", name);
+        return;
+    }
+
+    // every row starts with its filter type, 0 (none)
+    int stride = buf.width * 4 + 1;
+    std::vector<uint8_t> raw(stride * buf.height);
+    for (int y = 0; y < buf.height; y++) {
+        raw[y * stride] = 0;
+        to_rgba(&raw[y * stride + 1], &buf.pixels[y * buf.width], buf.width);
+    }
+    uLongf size = compressBound(raw.size());
+    std::vector<uint8_t> idat(size);
+    compress2(idat.data(), &size, raw.data(), raw.size(), Z_BEST_SPEED);
+    idat.resize(size);
+
+    std::vector<uint8_t> ihdr;
+    put_u32(ihdr, buf.width);
+    put_u32(ihdr, buf.height);
+    ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 }); // 8 bits, RGBA, no interlacing
+
+    fwrite("\x89PNG\r\n\x1a\n", 1, 8, f);
+    write_chunk(f, "IHDR", ihdr);
+    write_chunk(f, "IDAT", idat);
+    write_chunk(f, "IEND", {});
+    fclose(f);
+}
+
+void FrameCapture::write_raw(const Buffer &buf)
+{
+    std::vector<uint8_t> rgba(buf.pixels.size() * 4);
+    to_rgba(rgba.data(), buf.pixels.data(), buf.pixels.size());
+    fwrite(rgba.data(), 1, rgba.size(), out);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ring.h"
+
+/*
+ * Records every frame drawn. The sketch's thread only copies the frame into
+ * one of a few preallocated buffers, then a background thread encodes it.
+ * If the encoder falls behind and no buffer is free, the frame is dropped
+ * (and counted) instead of slowing the sketch down.
+ *
+ * Frames are written either as a sequence of PNG files (when the pathname
+ * ends in .png, and it must then contain one %d for the frame number, like
+ * %05d, and no other conversions), or as
+ * raw RGBA to a file or, if the pathname starts with '|', to a command's
+ * stdin.
+ */
+struct FrameCapture {
+    static constexpr int POOL_SIZE = 8;
+
+    struct Buffer {
+        std::vector<uint32_t> pixels;   // 0xAARRGGBB
+        int width = 0, height = 0;
+    };
+
+    bool enabled = false;
+    bool png = false;
+    std::string pathname;
+    FILE *out = nullptr;
+    bool is_pipe = false;
+
+    std::array<Buffer, POOL_SIZE> pool;
+    Ring<int, POOL_SIZE> free_buffers;  // encoder -> sketch
+    Ring<int, POOL_SIZE> full_buffers;  // sketch -> encoder
+    int current = -1;
+
+    std::thread encoder;
+    std::atomic<bool> stop_encoder = false;
+    unsigned long written = 0, dropped = 0;
+
+    // Buffers are allocated for frames of width x height, when known (0
+    // otherwise, e.g. before the window is opened: then on first use).
+    void start(const char *pathname, int width, int height);
+    void stop();
+    // returns where to copy the next frame, or nullptr if it must be dropped
+    uint32_t *acquire(int width, int height);
+    void submit();
+
+    void encoder_loop();
+    void write_png(const Buffer &buf);
+    void write_raw(const Buffer &buf);
+};
+
+extern FrameCapture frame_capture;
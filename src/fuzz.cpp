@@ -0,0 +1,21 @@
+#include <cstddef>
+#include <cstdint>
+#include "arduino_sdl.h"
+
+// Runs the sketch with libFuzzer, which turns each input into button
+// presses, potentiometer values and Serial input (see fuzz_input() for the
+// format). The sketch must be built with -Dmain=sketch_main, see the fuzz
+// target in the Makefile.
+int sketch_main();
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+    arduino_sdl::fuzz_init(sketch_main);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    arduino_sdl::fuzz_input(data, size);
+    return 0;
+}
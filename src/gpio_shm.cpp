@@ -0,0 +1,74 @@
+#include "gpio_shm.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+void GpioShm::start(const char *name)
+{
+    if (enabled)
+        return;
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd == -1) {
+        fprintf(stderr, "warning: couldn't create shared memory %s: %s\n", name, strerror(errno));
+        return;
+    }
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, sizeof(Segment)) == 0)
+        p = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "warning: couldn't map shared memory %s: %s\n", name, strerror(errno));
+        shm_unlink(name);
+        return;
+    }
+    // a segment left over by an earlier run may still have readers, which
+    // must see it as not ready until it's set up again
+    shm = (Segment *) p;
+    shm->magic.store(0);
+    shm->version    = VERSION;
+    shm->num_pins   = NUM_PINS;
+    shm->num_events = NUM_EVENTS;
+    shm->time = 0;
+    shm->head = 0;
+    for (auto &pin : shm->pins) {
+        pin.value = 0;
+        pin.analog = 0;
+        pin.input = -1;
+    }
+    shm->magic.store(MAGIC, std::memory_order_release);
+    snprintf(this->name, sizeof(this->name), "%s", name);
+    enabled = true;
+}
+
+void GpioShm::stop()
+{
+    if (!enabled)
+        return;
+    enabled = false;
+    // processes that still have it mapped keep it until they're done
+    munmap(shm, sizeof(Segment));
+    shm_unlink(name);
+    shm = nullptr;
+}
+
+void GpioShm::push(uint8_t pin, bool analog, uint16_t value, uint64_t time)
+{
+    shm->pins[pin].analog.store(analog, std::memory_order_relaxed);
+    shm->pins[pin].value.store(value, std::memory_order_release);
+    auto head = shm->head.load(std::memory_order_relaxed);
+    // as in a seqlock: a reader that sees any of the stores below, which
+    // overwrite event head - NUM_EVENTS, also sees the count that makes it
+    // stale (see gpio_shm.h)
+    std::atomic_thread_fence(std::memory_order_release);
+    auto &ev = shm->events[head % NUM_EVENTS];
+    ev.time.store(time, std::memory_order_relaxed);
+    ev.pin.store(pin, std::memory_order_relaxed);
+    ev.analog.store(analog, std::memory_order_relaxed);
+    ev.value.store(value, std::memory_order_relaxed);
+    shm->head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * The pins of a board, shared with other processes through a POSIX shared
+ * memory segment (see arduino_sdl::share_pins()), so that test rigs in any language
+ * can watch the sketch's outputs and drive its inputs, just by reading and
+ * writing memory. All fields are little endian and naturally aligned, and
+ * must be accessed atomically (e.g. __atomic_load_n() in C, or aligned loads
+ * on x86). Layout, version 1:
+ *
+ *   offset  size
+ *        0     4  magic: "ASGP"
+ *        4     4  version: 1
+ *        8     4  number of pins: 20
+ *       12     4  number of events in the ring: 1024
+ *       16     8  simulated time in microseconds, updated after every loop()
+ *       24     8  events written so far, event n is at index n % 1024
+ *       32   320  pins, 16 bytes each:
+ *                   +0   u32  value: level (0-1) or analog value last seen,
+ *                             written last (release)
+ *                   +4   u32  1 if value is analog
+ *                   +8   i32  input: written by other processes. When not -1,
+ *                             digitalRead() and analogRead() on the pin return
+ *                             it instead of asking its component
+ *                   +12  u32  reserved
+ *      352 16384  event ring, 16 bytes each:
+ *                   +0   u64  time in microseconds
+ *                   +8   u8   pin
+ *                   +9   u8   1 if analog
+ *                   +10  u16  value
+ *                   +12  u32  reserved
+ *
+ * Magic is written last, so a segment is ready once it reads right. The ring
+ * never waits for readers: a reader keeps its own count of events read, and
+ * an event it just copied is only valid if the event count is still less
+ * than 1024 ahead of it afterwards. Like with a seqlock, the reader reads
+ * the count (acquire) before copying the event, and again after an acquire
+ * fence; the writer counts each event (release), then has a release fence
+ * before writing over the oldest one.
+ */
+struct GpioShm {
+    static constexpr uint32_t MAGIC = 'A' | 'S' << 8 | 'G' << 16 | 'P' << 24;
+    static constexpr uint32_t VERSION = 1;
+    static constexpr int NUM_PINS = 20;
+    static constexpr int NUM_EVENTS = 1024;
+
+    struct Pin {
+        std::atomic<uint32_t> value;
+        std::atomic<uint32_t> analog;
+        std::atomic<int32_t> input;
+        uint32_t reserved;
+    };
+
+    struct Event {
+        std::atomic<uint64_t> time;
+        std::atomic<uint8_t> pin;
+        std::atomic<uint8_t> analog;
+        std::atomic<uint16_t> value;
+        uint32_t reserved;
+    };
+
+    struct Segment {
+        std::atomic<uint32_t> magic;
+        uint32_t version;
+        uint32_t num_pins;
+        uint32_t num_events;
+        std::atomic<uint64_t> time;
+        std::atomic<uint64_t> head;
+        Pin pins[NUM_PINS];
+        Event events[NUM_EVENTS];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+    static_assert(offsetof(Segment, pins) == 32 && sizeof(Pin) == 16);
+    static_assert(offsetof(Segment, events) == 352 && sizeof(Event) == 16);
+
+    bool enabled = false;
+    Segment *shm = nullptr;
+    char name[64];
+
+    void start(const char *name);
+    void stop();
+    void push(uint8_t pin, bool analog, uint16_t value, uint64_t time);
+
+    void record(uint8_t pin, bool analog, uint16_t value, uint64_t time)
+    {
+        if (enabled && pin < NUM_PINS)
+            push(pin, analog, value, time);
+    }
+
+    // true if another process drives the pin, which then reads as value
+    bool input(uint8_t pin, int &value)
+    {
+        if (!enabled || pin >= NUM_PINS)
+            return false;
+        int input = shm->pins[pin].input.load(std::memory_order_acquire);
+        if (input == -1)
+            return false;
+        value = input;
+        return true;
+    }
+
+    void set_time(uint64_t time)
+    {
+        if (enabled)
+            shm->time.store(time, std::memory_order_release);
+    }
+};
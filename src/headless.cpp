@@ -0,0 +1,35 @@
+/*
+ * A frontend that shows nothing and takes no input, for tests and fuzzing.
+ * Linked instead of arduino_sdl.cpp, it lets sketches run without SDL at all.
+ * Unlike with SDL, random() isn't seeded from the time, so runs repeat.
+ */
+
+#include <cstdio>
+#include "core.h"
+
+namespace frontend {
+
+void poll() { }
+void draw() { }
+void tone(uint8_t pin, unsigned frequency, unsigned long duration) { }
+void quit() { }
+
+} // namespace frontend
+
+namespace arduino_sdl {
+
+void start(const char *title, int width, int height) { }
+void use_software_renderer() { }
+Frame framebuffer() { return { nullptr, 0, 0 }; }
+
+void record_audio(const char *wav_pathname)
+{
+    fprintf(stderr, "warning: no audio without a frontend, %s won't be written\n", wav_pathname);
+}
+
+void capture_frames(const char *pathname)
+{
+    fprintf(stderr, "warning: no frames without a frontend, %s won't be written\n", pathname);
+}
+
+} // namespace arduino_sdl
@@ -0,0 +1,8 @@
+#include "arduino_sdl.h"
+
+// Runs a sketch built as a shared object and reloads it each time it gets
+// rebuilt, without closing the window. See the host target in the Makefile.
+int main(int argc, char *argv[])
+{
+    return arduino_sdl::run_hot_reloadable(argc > 1 ? argv[1] : "out/sketch.so");
+}
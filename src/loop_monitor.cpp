@@ -0,0 +1,114 @@
+#include "loop_monitor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "arduino_sdl.h"
+
+LoopMonitor loop_monitor;
+
+namespace {
+
+int64_t steady_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void LoopMonitor::start(unsigned long budget_us, unsigned long stall_ms)
+{
+    if (enabled)
+        return;
+    this->budget_us = budget_us;
+    this->stall_ms  = stall_ms;
+    stop_monitor = false;
+    monitor = std::thread([this] { monitor_loop(); });
+    enabled = true;
+    std::atexit([] { loop_monitor.stop(); });
+}
+
+void LoopMonitor::stop()
+{
+    if (!enabled)
+        return;
+    enabled = false;
+    stop_monitor = true;
+    monitor.join();
+    report();
+}
+
+void LoopMonitor::begin()
+{
+    start_us = micros();
+    started_at.store(steady_ns(), std::memory_order_release);
+}
+
+void LoopMonitor::end()
+{
+    started_at.store(-1, std::memory_order_release);
+    auto n = iteration.fetch_add(1, std::memory_order_relaxed);
+    auto duration = micros() - start_us;
+    if (budget_us && duration > budget_us)
+        if (!overruns.push({ .time = start_us, .duration = duration, .iteration = n }))
+            dropped++;
+}
+
+void LoopMonitor::monitor_loop()
+{
+    // often enough to catch a stall about when it happens
+    auto period = std::chrono::milliseconds(stall_ms ? std::clamp<uint64_t>(stall_ms / 4, 1, 50) : 50);
+    for (;;) {
+        bool done = stop_monitor.load();
+        for (Overrun o; overruns.pop(o); )
+            collect(o);
+        if (done)
+            break;
+        if (stall_ms)
+            check_stall();
+        std::this_thread::sleep_for(period);
+    }
+}
+
+void LoopMonitor::collect(const Overrun &o)
+{
+    total++;
+    // worst stays sorted, longest first
+    auto it = std::find_if(worst.begin(), worst.end(), [&](const Overrun &w) { return o.duration > w.duration; });
+    if (it != worst.end() || worst.size() < WORST) {
+        worst.insert(it, o);
+        if (worst.size() > WORST)
+            worst.pop_back();
+    }
+}
+
+void LoopMonitor::check_stall()
+{
+    auto start = started_at.load(std::memory_order_acquire);
+    auto n = iteration.load(std::memory_order_relaxed);
+    if (start < 0 || n == stalled_iteration)
+        return;
+    auto ms = (steady_ns() - start) / 1'000'000;
+    if (ms < int64_t(stall_ms))
+        return;
+    // only once per loop(), it may well be stuck for good
+    stalled_iteration = n;
+    fprintf(stderr, "warning: loop() #%llu hasn't returned for %lld ms\n",
+            (unsigned long long) n, (long long) ms);
+}
+
+void LoopMonitor::report()
+{
+    if (total == 0 && dropped == 0)
+        return;
+    fprintf(stderr, "loop monitor: %lu of %llu loop()s went over the %llu us budget",
+            total + dropped, (unsigned long long) iteration.load(), (unsigned long long) budget_us);
+    if (dropped > 0)
+        fprintf(stderr, " (%lu not recorded, ring was full)", dropped);
+    fprintf(stderr, "\nworst:\n");
+    for (auto &o : worst)
+        fprintf(stderr, "  #%-8llu at %10.3f s: %llu us\n", (unsigned long long) o.iteration,
+                o.time / 1e6, (unsigned long long) o.duration);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "ring.h"
+
+/*
+ * Watches how long each loop() takes. Iterations over the time budget are
+ * pushed into a ring by the sketch's thread, and a monitor thread collects
+ * them, keeping the worst ones for a report at the end. The monitor also
+ * acts as a watchdog, warning as soon as a loop() hasn't returned for too
+ * long. The sketch is never interrupted: it only stores a couple of numbers
+ * per loop(), and nothing at all when monitoring is off.
+ */
+struct LoopMonitor {
+    struct Overrun {
+        uint64_t time;      // when the loop() started, in micros()
+        uint64_t duration;  // in microseconds
+        uint64_t iteration;
+    };
+
+    static constexpr int WORST = 10;
+
+    bool enabled = false;
+    uint64_t budget_us = 0;
+    uint64_t stall_ms = 0;
+
+    // written by the sketch's thread
+    uint64_t start_us = 0;
+    std::atomic<uint64_t> iteration = 0;
+    std::atomic<int64_t> started_at = -1;   // steady clock, in ns; -1 outside loop()
+    Ring<Overrun, 1024> overruns;
+    unsigned long dropped = 0;
+
+    // owned by the monitor thread
+    std::thread monitor;
+    std::atomic<bool> stop_monitor = false;
+    std::vector<Overrun> worst;
+    unsigned long total = 0;
+    uint64_t stalled_iteration = UINT64_MAX;
+
+    void start(unsigned long budget_us, unsigned long stall_ms);
+    void stop();
+
+    void begin_loop()
+    {
+        if (enabled)
+            begin();
+    }
+
+    void end_loop()
+    {
+        if (enabled)
+            end();
+    }
+
+    void begin();
+    void end();
+    void monitor_loop();
+    void collect(const Overrun &o);
+    void check_stall();
+    void report();
+};
+
+extern LoopMonitor loop_monitor;
@@ -0,0 +1,113 @@
+#include "pin_trace.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include "arduino_sdl.h"
+
+PinTrace pin_trace;
+
+namespace {
+
+// VCD identifiers are made of printable characters. Digital levels of each
+// pin use the first NUM_PINS codes, analog values use the ones after them.
+char vcd_id(uint8_t pin, bool analog)
+{
+    return '!' + pin + (analog ? PinTrace::NUM_PINS : 0);
+}
+
+} // namespace
+
+void PinTrace::start(const char *pathname)
+{
+    if (enabled)
+        return;
+    out = fopen(pathname, "w");
+    if (!out) {
+        fprintf(stderr, "warning: couldn't open %s, pin tracing disabled\n", pathname);
+        return;
+    }
+    ring = std::make_unique<Ring<Event, 1 << 16>>();
+    write_header();
+    stop_writer = false;
+    writer = std::thread([this] { writer_loop(); });
+    enabled = true;
+    // sketches are usually closed with the window's close button, which
+    // exits without going through arduino_sdl::quit()
+    std::atexit([] { pin_trace.stop(); });
+}
+
+void PinTrace::stop()
+{
+    if (!enabled)
+        return;
+    enabled = false;
+    stop_writer = true;
+    writer.join();
+    fclose(out);
+    out = nullptr;
+    if (dropped > 0)
+        fprintf(stderr, "warning: pin trace dropped %lu events (ring was full)\n", dropped);
+}
+
+void PinTrace::push(uint8_t pin, bool analog, uint16_t value)
+{
+    if (pin >= NUM_PINS)
+        return;
+    if (!ring->push({ .time = micros(), .pin = pin, .analog = analog, .value = value }))
+        dropped++;
+}
+
+void PinTrace::write_header()
+{
+    auto t = std::time(nullptr);
+    fprintf(out, "$date %s$end\n", std::ctime(&t));
+    fprintf(out, "$version arduino_sdl $end\n");
+    fprintf(out, "$timescale 1us $end\n");
+    fprintf(out, "$scope module board $end\n");
+    for (int i = 0; i < NUM_PINS; i++) {
+        fprintf(out, "$var wire 1 %c pin%d $end\n",              vcd_id(i, false), i);
+        fprintf(out, "$var integer 16 %c pin%d_analog $end\n",   vcd_id(i, true),  i);
+    }
+    fprintf(out, "$upscope $end\n");
+    fprintf(out, "$enddefinitions $end\n");
+    fprintf(out, "$dumpvars\n");
+    for (int i = 0; i < NUM_PINS; i++) {
+        fprintf(out, "x%c\n",  vcd_id(i, false));
+        fprintf(out, "bx %c\n", vcd_id(i, true));
+    }
+    fprintf(out, "$end\n");
+}
+
+void PinTrace::write_event(const Event &ev)
+{
+    if (ev.time != last_time) {
+        fprintf(out, "#%llu\n", (unsigned long long) ev.time);
+        last_time = ev.time;
+    }
+    if (!ev.analog) {
+        fprintf(out, "%d%c\n", ev.value ? 1 : 0, vcd_id(ev.pin, false));
+        return;
+    }
+    char bits[17];
+    int n = 0;
+    for (int i = 15; i >= 0; i--)
+        if (n > 0 || (ev.value >> i & 1) || i == 0)
+            bits[n++] = '0' + (ev.value >> i & 1);
+    bits[n] = '\0';
+    fprintf(out, "b%s %c\n", bits, vcd_id(ev.pin, true));
+}
+
+void PinTrace::writer_loop()
+{
+    Event ev;
+    for (;;) {
+        bool done = stop_writer.load();
+        while (ring->pop(ev))
+            write_event(ev);
+        if (done)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    fflush(out);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include "ring.h"
+
+/*
+ * Records every pin level change into a preallocated ring buffer. A background
+ * thread drains the ring and writes it out as a Value Change Dump, which can
+ * be opened with GTKWave or any other waveform viewer.
+ * When tracing is off, record() costs a single branch.
+ */
+struct PinTrace {
+    struct Event {
+        uint64_t time;  // in microseconds
+        uint8_t pin;
+        bool analog;
+        uint16_t value;
+    };
+
+    static constexpr int NUM_PINS = 20;
+
+    bool enabled = false;
+    std::unique_ptr<Ring<Event, 1 << 16>> ring;
+    std::thread writer;
+    std::atomic<bool> stop_writer = false;
+    FILE *out = nullptr;
+    unsigned long dropped = 0;
+    uint64_t last_time = UINT64_MAX;
+
+    void start(const char *pathname);
+    void stop();
+    void push(uint8_t pin, bool analog, uint16_t value);
+    void record(uint8_t pin, bool analog, uint16_t value)
+    {
+        if (enabled)
+            push(pin, analog, value);
+    }
+
+    void write_header();
+    void write_event(const Event &ev);
+    void writer_loop();
+};
+
+extern PinTrace pin_trace;
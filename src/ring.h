@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+ * A fixed size ring buffer, safe to use with exactly one producer thread and
+ * one consumer thread without any locking. The size must be a power of two.
+ * push() and pop() never block: they just fail when the ring is full or empty.
+ */
+template <typename T, std::size_t N>
+struct Ring {
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+    std::array<T, N> buf;
+    alignas(64) std::atomic<std::size_t> head = 0; // only written by the producer
+    alignas(64) std::atomic<std::size_t> tail = 0; // only written by the consumer
+
+    bool push(const T &value)
+    {
+        auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+            return false;
+        buf[h & (N - 1)] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        value = buf[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // only for the consumer: like pop(), but leaves the value in the ring
+    bool peek(T &value) const
+    {
+        auto t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        value = buf[t & (N - 1)];
+        return true;
+    }
+
+    std::size_t size() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+};
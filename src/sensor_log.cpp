@@ -0,0 +1,85 @@
+#include "sensor_log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SensorLog::SensorLog(const char *pathname)
+{
+    int fd = open(pathname, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "warning: couldn't open sensor log %s\n", pathname);
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+    count = st.st_size / sizeof(Sample);
+    if (count > 0) {
+        void *p = mmap(nullptr, count * sizeof(Sample), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            fprintf(stderr, "warning: couldn't map sensor log %s\n", pathname);
+            count = 0;
+        } else {
+            samples = (const Sample *) p;
+            madvise(p, count * sizeof(Sample), MADV_SEQUENTIAL);
+        }
+    }
+    // the mapping stays valid after closing the file
+    close(fd);
+}
+
+SensorLog & SensorLog::operator=(SensorLog &&other)
+{
+    std::swap(samples, other.samples);
+    std::swap(count,   other.count);
+    std::swap(cursor,  other.cursor);
+    return *this;
+}
+
+SensorLog::~SensorLog()
+{
+    if (samples)
+        munmap((void *) samples, count * sizeof(Sample));
+}
+
+void SensorLog::seek(uint32_t t)
+{
+    // time almost always moves forward by a few samples at a time, so try
+    // walking from the cursor before falling back to a binary search
+    for (int i = 0; i < 8; i++) {
+        if (cursor + 1 < count && samples[cursor + 1].time <= t)
+            cursor++;
+        else if (samples[cursor].time <= t || cursor == 0)
+            return;
+        else
+            break;
+    }
+    auto it = std::upper_bound(samples, samples + count, t,
+                               [](uint32_t t, const Sample &s) { return t < s.time; });
+    cursor = it == samples ? 0 : it - samples - 1;
+}
+
+float SensorLog::step(uint32_t t)
+{
+    if (count == 0)
+        return 0.f;
+    seek(t);
+    return samples[cursor].value;
+}
+
+float SensorLog::at(uint32_t t)
+{
+    if (count == 0)
+        return 0.f;
+    seek(t);
+    const auto &a = samples[cursor];
+    if (t <= a.time || cursor + 1 == count)
+        return a.value;
+    const auto &b = samples[cursor + 1];
+    return a.value + (b.value - a.value) * float(t - a.time) / float(b.time - a.time);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+/*
+ * A recorded time series for a sensor, replayed in simulation time.
+ *
+ * The file is a flat array of little-endian records, sorted by time:
+ *
+ *     struct { uint32_t time_ms; float value; };
+ *
+ * (e.g. what numpy's tofile() writes for a structured array with fields
+ * '<u4' and '<f4'). The file is memory-mapped rather than read, so logs
+ * much bigger than RAM work fine: only the pages around the current time
+ * are ever touched.
+ */
+struct SensorLog {
+    struct Sample {
+        uint32_t time;
+        float value;
+    };
+
+    const Sample *samples = nullptr;
+    size_t count = 0;
+    size_t cursor = 0;     // index of the last sample with time <= the last lookup
+
+    SensorLog() = default;
+    explicit SensorLog(const char *pathname);
+    SensorLog(const SensorLog &) = delete;
+    SensorLog & operator=(const SensorLog &) = delete;
+    SensorLog(SensorLog &&other) { *this = std::move(other); }
+    SensorLog & operator=(SensorLog &&other);
+    ~SensorLog();
+
+    // linearly interpolated value at time t
+    float at(uint32_t t);
+    // value of the last sample at or before time t, without interpolation
+    float step(uint32_t t);
+
+    void seek(uint32_t t);
+};
@@ -0,0 +1,135 @@
+#include "sketch_loader.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <dlfcn.h>
+#include <link.h>
+#include <unistd.h>
+#include "arduino_sdl.h"
+
+HotReload hot_reload;
+
+namespace {
+
+std::filesystem::file_time_type modification_time(const std::string &pathname)
+{
+    std::error_code ec;
+    auto t = std::filesystem::last_write_time(pathname, ec);
+    return ec ? std::filesystem::file_time_type::min() : t;
+}
+
+// The writable segments of a loaded object, i.e. its .data and .bss, minus
+// what is only written while relocating it and then made read-only.
+std::vector<std::span<std::byte>> writable_segments(void *handle)
+{
+    struct link_map *map = nullptr;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0)
+        return {};
+    struct Search {
+        ElfW(Addr) base;
+        std::vector<std::span<std::byte>> segments;
+    } search = { .base = map->l_addr, .segments = {} };
+    dl_iterate_phdr([](struct dl_phdr_info *info, size_t, void *data) {
+        auto &search = *(Search *) data;
+        if (info->dlpi_addr != search.base)
+            return 0;
+        ElfW(Addr) relro_end = 0;
+        for (int i = 0; i < info->dlpi_phnum; i++)
+            if (info->dlpi_phdr[i].p_type == PT_GNU_RELRO)
+                relro_end = info->dlpi_phdr[i].p_vaddr + info->dlpi_phdr[i].p_memsz;
+        for (int i = 0; i < info->dlpi_phnum; i++) {
+            auto &ph = info->dlpi_phdr[i];
+            if (ph.p_type != PT_LOAD || !(ph.p_flags & PF_W))
+                continue;
+            auto start = std::max(ph.p_vaddr, relro_end), end = ph.p_vaddr + ph.p_memsz;
+            if (start < end)
+                search.segments.push_back({ (std::byte *) (info->dlpi_addr + start), end - start });
+        }
+        return 1;
+    }, &search);
+    return search.segments;
+}
+
+} // namespace
+
+bool SketchLibrary::load(const char *pathname)
+{
+    // RTLD_LOCAL keeps the sketch's symbols (setup, loop, its globals...)
+    // private to this load, so that several sketches can be loaded at once.
+    handle = dlopen(pathname, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "warning: couldn't load sketch: %s\n", dlerror());
+        return false;
+    }
+    // setup() and loop() are C++ functions, hence the mangled names
+    sketch.setup = (void (*)()) dlsym(handle, "_Z5setupv");
+    sketch.loop  = (void (*)()) dlsym(handle, "_Z4loopv");
+    sketch.main  = (int (*)())  dlsym(handle, "main");
+    if (!sketch.setup || !sketch.loop) {
+        fprintf(stderr, "warning: %s doesn't define setup() and loop()\n", pathname);
+        dlclose(handle);
+        handle = nullptr;
+        return false;
+    }
+    sketch.globals = writable_segments(handle);
+    return true;
+}
+
+bool SketchLibrary::load_copy(const char *pathname)
+{
+    // dlopen() would just return the same handle for the same path, so
+    // load a copy instead.
+    static int copies = 0;
+    auto copy = std::filesystem::temp_directory_path()
+              / ("arduino_sdl-" + std::to_string(getpid()) + "-" + std::to_string(++copies) + ".so");
+    std::error_code ec;
+    std::filesystem::copy_file(pathname, copy, std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec) {
+        fprintf(stderr, "warning: couldn't copy %s: %s\n", pathname, ec.message().c_str());
+        return false;
+    }
+    bool ok = load(copy.c_str());
+    std::filesystem::remove(copy, ec);
+    return ok;
+}
+
+bool HotReload::start(const char *pathname)
+{
+    this->pathname = pathname;
+    loaded_mtime = pending_mtime = modification_time(pathname);
+    if (!lib.load(pathname))
+        return false;
+    enabled = true;
+    return true;
+}
+
+bool HotReload::check()
+{
+    // stat() on every loop() would be way too slow
+    auto now = millis();
+    if (now - last_check < 250)
+        return false;
+    last_check = now;
+
+    auto mtime = modification_time(pathname);
+    if (mtime == std::filesystem::file_time_type::min() || mtime == loaded_mtime)
+        return false;
+    // wait until the file has stopped changing, so we don't catch the
+    // linker in the middle of writing it
+    if (mtime != pending_mtime) {
+        pending_mtime = mtime;
+        return false;
+    }
+
+    // Old versions are never unloaded: the first one is still running
+    // main(), and components may hold pointers into the others.
+    SketchLibrary next;
+    bool ok = next.load_copy(pathname.c_str());
+    loaded_mtime = mtime;
+    if (!ok)
+        return false;
+    lib = next;
+    fprintf(stderr, "reloaded %s\n", pathname.c_str());
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <vector>
+
+/* A sketch's entry points. */
+struct Sketch {
+    void (*setup)() = nullptr;
+    void (*loop)() = nullptr;
+    int (*main)() = nullptr;
+    // where its globals are, when loaded as a shared object (for snapshots)
+    std::vector<std::span<std::byte>> globals;
+};
+
+/*
+ * Loads sketches built as shared objects (see the host target in the
+ * Makefile). Every load gets its own copy of the sketch's globals.
+ */
+struct SketchLibrary {
+    Sketch sketch;
+    void *handle = nullptr;
+
+    bool load(const char *pathname);
+    // Loads a temporary copy of the file, so that the same sketch can be
+    // loaded more than once.
+    bool load_copy(const char *pathname);
+};
+
+/*
+ * Watches a sketch's shared object and loads it again whenever it gets
+ * rebuilt. Only the sketch is replaced: the window, textures and components
+ * all live in the host and are kept as they are.
+ */
+struct HotReload {
+    bool enabled = false;
+    std::string pathname;
+    SketchLibrary lib;
+    std::filesystem::file_time_type loaded_mtime, pending_mtime;
+    unsigned long last_check = 0;
+
+    bool start(const char *pathname);
+    // returns true if a new version of the sketch was loaded
+    bool check();
+};
+
+extern HotReload hot_reload;
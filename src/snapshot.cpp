@@ -0,0 +1,136 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+// the end of the program's data, where the heap starts (see end(3))
+extern "C" char end;
+
+namespace {
+
+void put_varint(std::vector<uint8_t> &out, uint64_t n)
+{
+    for ( ; n >= 0x80; n >>= 7)
+        out.push_back(n | 0x80);
+    out.push_back(n);
+}
+
+uint64_t get_varint(const std::vector<uint8_t> &in, std::size_t &pos)
+{
+    uint64_t n = 0;
+    for (int shift = 0; ; shift += 7) {
+        auto b = in[pos++];
+        n |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return n;
+    }
+}
+
+// Only the main malloc() arena, up to the program break: big blocks are
+// mmap()ed elsewhere, and so are other threads' arenas.
+bool in_heap(uintptr_t p)
+{
+    return p >= uintptr_t(&end) && p < uintptr_t(sbrk(0));
+}
+
+// Whether copying from into mem changes any of its words pointing into the
+// heap, or makes one point there.
+bool changes_heap_pointers(std::span<const std::byte> mem, const uint8_t *from)
+{
+    for (std::size_t i = 0; i + sizeof(uintptr_t) <= mem.size(); i += sizeof(uintptr_t)) {
+        uintptr_t old, loaded;
+        std::memcpy(&old, mem.data() + i, sizeof(old));
+        std::memcpy(&loaded, from + i, sizeof(loaded));
+        if (old != loaded && (in_heap(old) || in_heap(loaded)))
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+void StateBuffer::globals(std::span<std::byte> mem)
+{
+    static bool warned = false;
+    if (loading && !warned && changes_heap_pointers(mem, data.data() + pos)) {
+        fprintf(stderr, "warning: restored globals point to memory allocated since, "
+                        "which snapshots don't restore (e.g. a String)\n");
+        warned = true;
+    }
+    bytes(mem.data(), mem.size());
+}
+
+void SnapshotHistory::start(uint64_t interval_us, std::size_t count)
+{
+    enabled = true;
+    interval = interval_us;
+    max_entries = count;
+}
+
+void SnapshotHistory::push(uint64_t time, std::vector<uint8_t> &&state)
+{
+    if (!entries.empty())
+        entries.back().diff = diff(state, newest);
+    entries.push_back({ .time = time, .diff = {} });
+    newest = std::move(state);
+    if (entries.size() > max_entries)
+        entries.pop_front();
+    next = time + interval;
+}
+
+bool SnapshotHistory::rewind(uint64_t time, std::vector<uint8_t> &state, uint64_t &at)
+{
+    if (entries.empty() || entries.front().time > time)
+        return false;
+    while (entries.back().time > time) {
+        entries.pop_back();
+        apply(newest, entries.back().diff);
+        entries.back().diff.clear();
+    }
+    state = newest;
+    at = entries.back().time;
+    next = at + interval;
+    return true;
+}
+
+// The size of the result, then runs of unchanged bytes, each followed by
+// the bytes that changed (XORed with the old ones).
+std::vector<uint8_t> SnapshotHistory::diff(const std::vector<uint8_t> &from, const std::vector<uint8_t> &to)
+{
+    std::vector<uint8_t> out;
+    put_varint(out, to.size());
+    auto size = std::max(from.size(), to.size());
+    auto at = [&](const std::vector<uint8_t> &v, std::size_t i) -> uint8_t { return i < v.size() ? v[i] : 0; };
+    for (std::size_t i = 0; i < size; ) {
+        auto start = i;
+        while (i < size && at(from, i) == at(to, i))
+            i++;
+        if (i == size)
+            break;
+        auto changed = i;
+        // short runs of equal bytes cost more to skip than to keep
+        while (i < size && (at(from, i) != at(to, i)
+                            || (i + 1 < size && at(from, i+1) != at(to, i+1))))
+            i++;
+        put_varint(out, changed - start);
+        put_varint(out, i - changed);
+        for (auto j = changed; j < i; j++)
+            out.push_back(at(from, j) ^ at(to, j));
+    }
+    return out;
+}
+
+void SnapshotHistory::apply(std::vector<uint8_t> &state, const std::vector<uint8_t> &diff)
+{
+    std::size_t pos = 0;
+    auto size = get_varint(diff, pos);
+    state.resize(std::max<std::size_t>(state.size(), size));
+    for (std::size_t i = 0; pos < diff.size(); ) {
+        i += get_varint(diff, pos);
+        auto n = get_varint(diff, pos);
+        for ( ; n--; i++)
+            state[i] ^= diff[pos++];
+    }
+    state.resize(size);
+}
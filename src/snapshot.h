@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <span>
+#include <type_traits>
+#include <vector>
+#include "ring.h"
+
+/*
+ * The simulation's state as plain bytes, for snapshots. Whatever has state
+ * lists its fields in a state(s) method, e.g. s(value, pressed), which both
+ * saves and loads them, depending on s.loading. Loading must be done in the
+ * same order, on the same objects (same number of components and so on).
+ */
+struct StateBuffer {
+    std::vector<uint8_t> data;
+    std::size_t pos = 0;
+    bool loading = false;
+
+    void bytes(void *p, std::size_t size)
+    {
+        if (loading) {
+            std::memcpy(p, data.data() + pos, size);
+            pos += size;
+        } else
+            data.insert(data.end(), (uint8_t *) p, (uint8_t *) p + size);
+    }
+
+    template <typename T>
+    void field(T &x)
+    {
+        if constexpr (requires { x.state(*this); })
+            x.state(*this);
+        else {
+            static_assert(std::is_trivially_copyable_v<T>);
+            bytes(&x, sizeof(T));
+        }
+    }
+
+    // containers: their size, then their elements
+    template <typename C>
+        requires requires (C c) { c.resize(0); c.begin(); }
+    void field(C &c)
+    {
+        uint32_t size = c.size();
+        field(size);
+        c.resize(size);
+        for (auto &x : c)
+            field(x);
+    }
+
+    // memory of a fixed size
+    void field(std::span<std::byte> mem) { bytes(mem.data(), mem.size()); }
+    // A sketch's globals. What they point to isn't part of the snapshot, so
+    // loading warns (once) when that changes pointers into the heap, e.g.
+    // those of a String that was reallocated since.
+    void globals(std::span<std::byte> mem);
+
+    // only safe with both ends of the ring on this thread
+    template <typename T, std::size_t N>
+    void field(Ring<T, N> &r)
+    {
+        uint32_t size = r.size();
+        field(size);
+        if (loading) {
+            r.tail = r.head.load();
+            for (T x; size--; ) {
+                field(x);
+                r.push(x);
+            }
+        } else
+            for (auto i = r.tail.load(); i != r.head.load(); i++)
+                field(r.buf[i & (N - 1)]);
+    }
+
+    void operator()(auto &&...xs) { (field(xs), ...); }
+};
+
+/*
+ * Snapshots taken every so often, keeping only the last few. Only the
+ * newest one is kept whole: every other one is stored as its difference
+ * from the next (zero runs of their XOR), which is small as most of the
+ * state doesn't change from one snapshot to the next. Going back a few
+ * snapshots only needs the few differences in between.
+ */
+struct SnapshotHistory {
+    struct Entry {
+        uint64_t time;
+        std::vector<uint8_t> diff; // turns the next snapshot into this one
+    };
+
+    bool enabled = false;
+    uint64_t interval = 0;
+    uint64_t next = 0;
+    std::size_t max_entries = 0;
+    std::deque<Entry> entries;
+    std::vector<uint8_t> newest;
+
+    void start(uint64_t interval_us, std::size_t count);
+    bool due(uint64_t time) const { return enabled && time >= next; }
+    void push(uint64_t time, std::vector<uint8_t> &&state);
+    // Puts the newest snapshot taken at or before time in state, and forgets
+    // every one after it. Returns false if there's none that old.
+    bool rewind(uint64_t time, std::vector<uint8_t> &state, uint64_t &at);
+    void clear() { entries.clear(); newest.clear(); next = 0; }
+
+    static std::vector<uint8_t> diff(const std::vector<uint8_t> &from, const std::vector<uint8_t> &to);
+    static void apply(std::vector<uint8_t> &state, const std::vector<uint8_t> &diff);
+};
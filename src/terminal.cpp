@@ -0,0 +1,532 @@
+/*
+ * A frontend that draws the boards as text on a terminal, for machines
+ * without a display, e.g. over SSH. Linked instead of arduino_sdl.cpp (see
+ * 'make terminal'). Components go where they would be in the window, one
+ * cell for every 8x16 pixels. Each frame only the cells that changed since
+ * the last one are sent, so it keeps up over slow links too.
+ *
+ * Keys: 1-9 and 0 press (and then release) the buttons, q/a, w/s, e/d, r/f
+ * and t/g turn potentiometers and move sonar obstacles, in the order they
+ * were connected. Backspace goes back a second, when keeping snapshots, and
+ * Ctrl-C quits. Terminals don't tell when keys are released, so buttons
+ * stay pressed until their key comes again. When stdout is the terminal,
+ * Serial output is shown in the last few lines instead.
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "core.h"
+
+namespace {
+
+constexpr int CELL_WIDTH = 8, CELL_HEIGHT = 16;
+constexpr int SERIAL_ROWS = 6;
+constexpr const char *BUTTON_KEYS = "1234567890";
+constexpr const char *KNOB_KEYS[] = { "qa", "ws", "ed", "rf", "tg" };
+constexpr u32 TEXT_COLOR = 0xc0c0c0ff, LABEL_COLOR = 0x808080ff;
+
+struct Cell {
+    char32_t ch = ' ';
+    u32 fg = TEXT_COLOR;
+    u32 bg = 0;     // 0 leaves the terminal's own
+    bool operator==(const Cell &) const = default;
+};
+
+u32 lerp_rgba(u32 a, u32 b, float t)
+{
+    u32 r = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        float x = (a >> shift & 0xff) * (1.f - t) + (b >> shift & 0xff) * t;
+        r |= u32(x) << shift;
+    }
+    return r;
+}
+
+void append_utf8(std::string &s, char32_t c)
+{
+    if (c < 0x80)
+        s += char(c);
+    else if (c < 0x800) {
+        s += char(0xc0 | c >> 6);
+        s += char(0x80 | (c & 0x3f));
+    } else {
+        s += char(0xe0 | c >> 12);
+        s += char(0x80 | (c >> 6 & 0x3f));
+        s += char(0x80 | (c & 0x3f));
+    }
+}
+
+volatile std::sig_atomic_t interrupted = 0;
+
+struct {
+    int fd = -1;
+    termios saved;
+    int width = 0, height = 0;
+    // what's being drawn, and what the terminal shows
+    std::vector<Cell> cells, shown;
+    u32 pen_fg = 0, pen_bg = 0;
+    std::string out;
+
+    // Serial output, when stdout is the terminal: the sketch writes into
+    // a pipe, which is read on every poll()
+    int serial_fd = -1, stdout_fd = -1;
+    std::deque<std::string> serial_lines = { "" };
+
+    unsigned tone_frequency = 0;
+    uint8_t tone_pin = 0;
+    unsigned long tone_end = 0;
+
+    bool init(const char *title)
+    {
+        fd = open("/dev/tty", O_RDWR | O_CLOEXEC);
+        if (fd == -1 || tcgetattr(fd, &saved) == -1) {
+            fprintf(stderr, "warning: no terminal to draw on\n");
+            if (fd != -1)
+                close(fd);
+            fd = -1;
+            return false;
+        }
+        // keys arrive as soon as they're typed, without blocking, and
+        // Ctrl-C still sends SIGINT
+        termios raw = saved;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &raw);
+        out = "\x1b[?1049h\x1b[?25l\x1b]0;";
+        out += title;
+        out += "\x07";
+        write_out();
+        if (isatty(STDOUT_FILENO))
+            redirect_stdout();
+        return true;
+    }
+
+    void redirect_stdout()
+    {
+        int fds[2];
+        if (pipe(fds) == -1)
+            return;
+        fflush(stdout);
+        stdout_fd = dup(STDOUT_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        // rather lose output than have the sketch stuck on a full pipe
+        fcntl(STDOUT_FILENO, F_SETFL, fcntl(STDOUT_FILENO, F_GETFL) | O_NONBLOCK);
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        serial_fd = fds[0];
+        setvbuf(stdout, nullptr, _IOLBF, 0);
+    }
+
+    // Only what's safe in a signal handler, see on_signal().
+    void restore()
+    {
+        if (fd == -1)
+            return;
+        const char reset[] = "\x1b[0m\x1b[?25h\x1b[?1049l";
+        (void) !::write(fd, reset, sizeof(reset) - 1);
+        tcsetattr(fd, TCSANOW, &saved);
+        if (stdout_fd != -1)
+            dup2(stdout_fd, STDOUT_FILENO);
+    }
+
+    void close_all()
+    {
+        if (fd == -1)
+            return;
+        fflush(stdout);
+        read_serial();
+        restore();
+        close(fd);
+        fd = -1;
+        if (serial_fd != -1) {
+            close(serial_fd);
+            close(stdout_fd);
+            serial_fd = stdout_fd = -1;
+        }
+    }
+
+    void write_out()
+    {
+        for (std::size_t done = 0; done < out.size(); ) {
+            auto n = ::write(fd, out.data() + done, out.size() - done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+        out.clear();
+    }
+
+    void read_serial()
+    {
+        if (serial_fd == -1)
+            return;
+        clearerr(stdout);
+        char buf[4096];
+        for (ssize_t n; (n = read(serial_fd, buf, sizeof(buf))) > 0; )
+            for (auto c : std::string_view(buf, n)) {
+                if (c == '\n') {
+                    serial_lines.emplace_back();
+                    if (serial_lines.size() > SERIAL_ROWS)
+                        serial_lines.pop_front();
+                } else if (c != '\r')
+                    serial_lines.back() += c;
+            }
+    }
+
+    // Starts over on a blank screen whenever the terminal changes size.
+    void resize()
+    {
+        winsize ws;
+        int w = 80, h = 24;
+        if (ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0)
+            w = ws.ws_col, h = ws.ws_row;
+        if (w == width && h == height)
+            return;
+        width = w;
+        height = h;
+        cells.assign(w * h, Cell{});
+        shown.assign(w * h, Cell{});
+        out += "\x1b[0m\x1b[2J";
+        pen_fg = pen_bg = 0;
+    }
+
+    void put(int x, int y, char32_t ch, u32 fg = TEXT_COLOR, u32 bg = 0)
+    {
+        if (x >= 0 && x < width && y >= 0 && y < height)
+            cells[y * width + x] = { .ch = ch, .fg = fg, .bg = bg };
+    }
+
+    void text(int x, int y, std::string_view s, u32 fg = TEXT_COLOR, u32 bg = 0)
+    {
+        for (auto c : s)
+            put(x++, y, c, fg, bg);
+    }
+
+    // Sends the cells that changed, moving the cursor and changing colors
+    // only when needed.
+    void flush()
+    {
+        int at_x = -1, at_y = -1;
+        char buf[64];
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                auto &c = cells[y * width + x];
+                auto &s = shown[y * width + x];
+                if (c == s)
+                    continue;
+                if (x != at_x || y != at_y)
+                    out.append(buf, snprintf(buf, sizeof(buf), "\x1b[%d;%dH", y + 1, x + 1));
+                if (c.fg != pen_fg || c.bg != pen_bg) {
+                    int n = snprintf(buf, sizeof(buf), "\x1b[0;38;2;%u;%u;%u",
+                                     c.fg >> 24, c.fg >> 16 & 0xff, c.fg >> 8 & 0xff);
+                    if (c.bg != 0)
+                        n += snprintf(buf + n, sizeof(buf) - n, ";48;2;%u;%u;%u",
+                                      c.bg >> 24, c.bg >> 16 & 0xff, c.bg >> 8 & 0xff);
+                    out.append(buf, n);
+                    out += 'm';
+                    pen_fg = c.fg;
+                    pen_bg = c.bg;
+                }
+                append_utf8(out, c.ch);
+                s = c;
+                at_x = x + 1;
+                at_y = y;
+            }
+        }
+        if (!out.empty())
+            write_out();
+    }
+} term;
+
+void on_signal(int sig)
+{
+    // the first Ctrl-C asks to quit, in case the sketch never lets go,
+    // the next one kills it
+    if (!interrupted) {
+        interrupted = 1;
+        return;
+    }
+    term.restore();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// Buttons and knobs (whatever turns with the mouse wheel), numbered in the
+// same order every time, which gives them their keys.
+void for_each_input(auto &&on_button, auto &&on_knob)
+{
+    int buttons = 0, knobs = 0;
+    for (auto &b : boards)
+        b.components.for_each([&]<typename T>(std::vector<T> &pool) {
+            for (auto &c : pool) {
+                if constexpr (std::is_same_v<T, Button>)
+                    on_button(c, buttons++);
+                else if constexpr (requires { c.mouse_wheel(Point{}, true); })
+                    on_knob(c, knobs++);
+            }
+        });
+}
+
+int cell_x(Point p) { return p.x / CELL_WIDTH; }
+int cell_y(Point p) { return p.y / CELL_HEIGHT; }
+
+
+
+/*
+ * How each component looks. Keys are written below the components that
+ * take them, see draw().
+ */
+
+void draw_component(LED &led)
+{
+    term.put(cell_x(led.pos), cell_y(led.pos), U'●', lerp_rgba(led.color_min, led.color_max, led.val / 255.f));
+}
+
+void draw_component(Button &button)
+{
+    int x = cell_x(button.pos), y = cell_y(button.pos);
+    term.text(x, y, button.pressed ? "[#]" : "[ ]", button.pressed ? 0xffffffff : TEXT_COLOR);
+}
+
+void draw_component(Potentiometer &pot)
+{
+    int x = cell_x(pot.pos), y = cell_y(pot.pos);
+    int filled = (pot.value * 8 + 512) / 1023;
+    for (int i = 0; i < 8; i++)
+        term.put(x + i, y, i < filled ? U'█' : U'░');
+    char buf[8];
+    term.text(x + 9, y, std::string_view(buf, snprintf(buf, sizeof(buf), "%4d", pot.value)));
+}
+
+void draw_component(Sensor &sensor)
+{
+    int x = cell_x(sensor.pos), y = cell_y(sensor.pos);
+    auto color = sensor.digital ? lerp_rgba(0x400000ff, 0xff0000ff, sensor.last)
+                                : lerp_rgba(0x000040ff, 0x4040ffff, sensor.last / 1023.f);
+    term.put(x, y, U'●', color);
+    if (!sensor.digital) {
+        char buf[8];
+        term.text(x + 2, y, std::string_view(buf, snprintf(buf, sizeof(buf), "%d", sensor.last)));
+    }
+}
+
+void draw_component(Sonar &sonar)
+{
+    int x = cell_x(sonar.pos), y = cell_y(sonar.pos);
+    term.text(x, y, "((");
+    term.put(x + 2, y, U'•', sonar.level ? 0x40ff40ff : TEXT_COLOR);
+    term.text(x + 3, y, "))");
+    char buf[16];
+    int n = sonar.distance < Sonar::MIN_CM || sonar.distance > Sonar::MAX_CM
+          ? snprintf(buf, sizeof(buf), " --- cm")
+          : snprintf(buf, sizeof(buf), " %3d cm", int(sonar.distance));
+    term.text(x + 5, y, std::string_view(buf, n));
+}
+
+void draw_component(LCD &lcd)
+{
+    int x = cell_x(lcd.pos), y = cell_y(lcd.pos);
+    int w = lcd.size.x, h = lcd.size.y;
+    term.put(x,         y,         U'┌');
+    term.put(x + w + 1, y,         U'┐');
+    term.put(x,         y + h + 1, U'└');
+    term.put(x + w + 1, y + h + 1, U'┘');
+    for (int i = 1; i <= w; i++) {
+        term.put(x + i, y,         U'─');
+        term.put(x + i, y + h + 1, U'─');
+    }
+    u32 fg = lcd.backlight ? 0xffffffff : 0x8090a0ff;
+    u32 bg = lcd.backlight ? 0x2040c0ff : 0x101830ff;
+    for (int row = 0; row < h; row++) {
+        term.put(x,         y + row + 1, U'│');
+        term.put(x + w + 1, y + row + 1, U'│');
+        for (int col = 0; col < w; col++) {
+            auto c = lcd.char_vec[row * w + col];
+            // custom characters can't be shown, and the rest of the
+            // display's font isn't ASCII
+            char32_t ch = c < 16 ? U'▒' : c < 0x80 ? char32_t(c) : U'?';
+            term.put(x + col + 1, y + row + 1, ch, fg, bg);
+        }
+    }
+}
+
+// In braille, 2x4 pixels to a cell.
+void draw_component(OLED &oled)
+{
+    static constexpr uint8_t DOTS[4][2] = { {0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80} };
+    int x = cell_x(oled.pos), y = cell_y(oled.pos);
+    for (int row = 0; row < oled.height / 4; row++)
+        for (int col = 0; col < OLED::WIDTH / 2; col++) {
+            char32_t ch = U'⠀';
+            for (int dy = 0; dy < 4; dy++)
+                for (int dx = 0; dx < 2; dx++)
+                    if (oled.pixel(col * 2 + dx, row * 4 + dy))
+                        ch |= DOTS[dy][dx];
+            term.put(x + col, y + row, ch, 0xa0e0ffff);
+        }
+}
+
+// One sparkline per channel, with the most recent columns.
+void draw_component(Plotter &plot)
+{
+    static constexpr u32 COLORS[Plotter::MAX_CHANNELS] = {
+        0x4080ffff, 0xff4040ff, 0x40ff40ff, 0xffff40ff,
+        0xff40ffff, 0x40ffffff, 0xff8000ff, 0xc0c0c0ff,
+    };
+    static constexpr char32_t BARS[] = U"▁▂▃▄▅▆▇█";
+    int x = cell_x(plot.rect.pos), y = cell_y(plot.rect.pos);
+    auto size = plot.columns[0].size();
+    auto n = std::min<uint64_t>({ plot.column + 1, size, uint64_t(std::max(plot.rect.size.x / CELL_WIDTH, 1)) });
+    auto first = plot.column + 1 - n;
+    for (int ch = 0; ch < plot.channels; ch++) {
+        auto &columns = plot.columns[ch];
+        float lo = INFINITY, hi = -INFINITY;
+        for (auto i = first; i <= plot.column; i++) {
+            lo = std::min(lo, columns[i % size].min);
+            hi = std::max(hi, columns[i % size].max);
+        }
+        for (auto i = first; i <= plot.column; i++) {
+            auto &c = columns[i % size];
+            if (c.min > c.max)
+                continue;
+            float t = hi > lo ? ((c.min + c.max) / 2 - lo) / (hi - lo) : 0.5f;
+            term.put(x + int(i - first), y + ch, BARS[std::clamp(int(t * 8), 0, 7)], COLORS[ch]);
+        }
+    }
+}
+
+} // namespace
+
+
+
+namespace frontend {
+
+void poll()
+{
+    if (term.fd == -1)
+        return;
+    if (interrupted)
+        running = false;
+    term.read_serial();
+    char buf[64];
+    auto n = read(term.fd, buf, sizeof(buf));
+    for (ssize_t i = 0; i < n; i++) {
+        char c = buf[i];
+        // arrows and such: the rest is their escape sequence
+        if (c == '\x1b')
+            break;
+        if (c == '\x7f' || c == '\b') {
+            request_rewind(1'000'000);
+            continue;
+        }
+        for_each_input(
+            [&](Button &b, int index) {
+                if (index < 10 && BUTTON_KEYS[index] == c)
+                    b.mouse_click(b.pos, !b.pressed);
+            },
+            [&](auto &knob, int index) {
+                if (index < 5 && (KNOB_KEYS[index][0] == c || KNOB_KEYS[index][1] == c))
+                    knob.mouse_wheel(knob.pos, c == KNOB_KEYS[index][0]);
+            });
+    }
+}
+
+void draw()
+{
+    if (term.fd == -1)
+        return;
+    term.resize();
+    std::fill(term.cells.begin(), term.cells.end(), Cell{});
+    for (auto &b : boards)
+        b.components.for_each([]<typename T>(std::vector<T> &pool) {
+            if constexpr (requires (T &c) { draw_component(c); })
+                for (auto &c : pool)
+                    draw_component(c);
+        });
+    for_each_input(
+        [](Button &b, int index) {
+            if (index < 10)
+                term.put(cell_x(b.pos) + 1, cell_y(b.pos) + 1, BUTTON_KEYS[index], LABEL_COLOR);
+        },
+        [](auto &knob, int index) {
+            if (index < 5) {
+                char label[] = { KNOB_KEYS[index][0], '/', KNOB_KEYS[index][1] };
+                term.text(cell_x(knob.pos), cell_y(knob.pos) + 1, std::string_view(label, 3), LABEL_COLOR);
+            }
+        });
+    if (term.tone_frequency != 0 && term.tone_end != 0 && micros() >= term.tone_end)
+        term.tone_frequency = 0;
+    if (term.tone_frequency != 0) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "tone %u Hz on pin %d", term.tone_frequency, term.tone_pin);
+        term.text(term.width - n, 0, std::string_view(buf, n));
+    }
+    if (term.serial_fd != -1 && term.height > SERIAL_ROWS * 2) {
+        int top = term.height - SERIAL_ROWS;
+        for (int x = 0; x < term.width; x++)
+            term.put(x, top, U'─', LABEL_COLOR);
+        term.text(2, top, " Serial ", LABEL_COLOR);
+        int y = top + 1;
+        // the last line is the one still being written
+        for (auto it = term.serial_lines.end() - std::min<std::size_t>(term.serial_lines.size(), SERIAL_ROWS - 1);
+             it != term.serial_lines.end(); ++it)
+            term.text(0, y++, std::string_view(*it).substr(0, term.width));
+    }
+    term.flush();
+}
+
+void tone(uint8_t pin, unsigned frequency, unsigned long duration)
+{
+    if (frequency == 0 && pin != term.tone_pin)
+        return;
+    term.tone_pin = pin;
+    term.tone_frequency = frequency;
+    term.tone_end = duration ? micros() + duration * 1000 : 0;
+}
+
+void quit()
+{
+    term.close_all();
+}
+
+} // namespace frontend
+
+
+
+namespace arduino_sdl {
+
+void start(const char *title, int width, int height)
+{
+    if (headless || !term.init(title))
+        return;
+    board->random_state = std::time(nullptr);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    std::atexit([] { term.close_all(); });
+}
+
+void use_software_renderer() { }
+Frame framebuffer() { return { nullptr, 0, 0 }; }
+
+void record_audio(const char *wav_pathname)
+{
+    fprintf(stderr, "warning: no audio on a terminal, %s won't be written\n", wav_pathname);
+}
+
+void capture_frames(const char *pathname)
+{
+    fprintf(stderr, "warning: no frames on a terminal, %s won't be written\n", pathname);
+}
+
+} // namespace arduino_sdl